@@ -0,0 +1,128 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "category_interner.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace {
+  const size_t kInitialSlotCnt = 1024;
+}
+
+
+// max() takes it by reference
+const size_t CategoryInterner::kArenaBlockSize;
+
+
+CategoryInterner::CategoryInterner()
+  : arena_used_(0),
+    slots_(kInitialSlotCnt) {
+}
+
+
+uint32_t CategoryInterner::intern(const ByteView &name) {
+  uint64_t h = hash(name);
+  size_t mask = slots_.size() - 1;
+  for (size_t i = h & mask; slots_[i].id_plus_one; i = (i + 1) & mask) {
+    const Slot &slot = slots_[i];
+    if (slot.hash == h && names_[slot.id_plus_one - 1] == name) {
+      return slot.id_plus_one - 1;
+    }
+  }
+
+  uint32_t id = names_.size();
+  names_.push_back({copy_to_arena(name), name.size});
+  if (names_.size() * 2 > slots_.size()) {
+    grow();
+  }
+  insert(&slots_, {h, id + 1});
+  return id;
+}
+
+
+int64_t CategoryInterner::find(const ByteView &name) const {
+  uint64_t h = hash(name);
+  size_t mask = slots_.size() - 1;
+  for (size_t i = h & mask; slots_[i].id_plus_one; i = (i + 1) & mask) {
+    const Slot &slot = slots_[i];
+    if (slot.hash == h && names_[slot.id_plus_one - 1] == name) {
+      return slot.id_plus_one - 1;
+    }
+  }
+  return -1;
+}
+
+
+uint64_t CategoryInterner::hash(const ByteView &name) {
+  // 8 bytes at a time, categories are short prefixes of keys
+  const uint64_t kMul = 0x9e3779b97f4a7c15lu;
+  uint64_t h = name.size * kMul;
+  size_t i = 0;
+  for (; i + 8 <= name.size; i += 8) {
+    uint64_t word;
+    memcpy(&word, name.data + i, 8);
+    h = (h ^ word) * kMul;
+    h ^= h >> 32;
+  }
+  if (i < name.size) {
+    uint64_t word = 0;
+    memcpy(&word, name.data + i, name.size - i);
+    h = (h ^ word) * kMul;
+    h ^= h >> 32;
+  }
+  return h;
+}
+
+
+const char *CategoryInterner::copy_to_arena(const ByteView &name) {
+  if (arena_.empty() || arena_used_ + name.size > kArenaBlockSize) {
+    // a name longer than a block gets a block of its own
+    arena_.emplace_back(new char[max(kArenaBlockSize, name.size)]);
+    arena_used_ = 0;
+  }
+  char *dest = arena_.back().get() + arena_used_;
+  memcpy(dest, name.data, name.size);
+  arena_used_ += name.size;
+  return dest;
+}
+
+
+void CategoryInterner::insert(vector<Slot> *slots, const Slot &slot) {
+  size_t mask = slots->size() - 1;
+  size_t i = slot.hash & mask;
+  while ((*slots)[i].id_plus_one) {
+    i = (i + 1) & mask;
+  }
+  (*slots)[i] = slot;
+}
+
+
+void CategoryInterner::grow() {
+  vector<Slot> slots(slots_.size() * 2);
+  for (const auto &slot : slots_) {
+    if (slot.id_plus_one) {
+      insert(&slots, slot);
+    }
+  }
+  slots_.swap(slots);
+}
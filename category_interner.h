@@ -0,0 +1,62 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include "item_view.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+
+// Maps category names to dense ids 0, 1, 2.. in the order they are first seen, so the stats of
+// categories can be kept in arrays indexed by id. The names are copied into an arena of large
+// blocks and looked up through an open-addressing table of their hashes, so resolving the
+// category of an item does not allocate unless the category is new.
+class CategoryInterner {
+public:
+  CategoryInterner();
+
+  // Returns the id of the name, a new name gets the next id.
+  uint32_t intern(const ByteView &name);
+  // Returns the id of the name, or -1 if it was never interned.
+  int64_t find(const ByteView &name) const;
+  // The view stays valid as long as the interner.
+  const ByteView &name(uint32_t id) const { return names_[id]; }
+  size_t size() const { return names_.size(); }
+
+private:
+  struct Slot {
+    uint64_t hash;
+    // id + 1, 0 for an empty slot
+    uint32_t id_plus_one;
+  };
+
+  static uint64_t hash(const ByteView &name);
+  static void insert(std::vector<Slot> *slots, const Slot &slot);
+  const char *copy_to_arena(const ByteView &name);
+  void grow();
+
+  static const size_t kArenaBlockSize = 64 * 1024;
+  std::vector<std::unique_ptr<char[]>> arena_;
+  size_t arena_used_;
+  std::vector<ByteView> names_;
+  // size is a power of 2, kept at most half full
+  std::vector<Slot> slots_;
+};
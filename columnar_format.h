@@ -0,0 +1,48 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <stdint.h>
+
+
+// A columnar dump written by --dump-format=columnar is a sequence of self-contained blocks, so
+// the part files of the scan threads are simply concatenated. Every block is a ColumnarBlockHeader
+// followed by item_cnt values of every column, each column stored contiguously in this order:
+//   uint64_t cas
+//   uint32_t val_size            nbytes of the item, including the trailing "\r\n"
+//   int32_t  expire_in_secs      exptime - current time, as in the text dump
+//   int32_t  last_touch_secs_ago current time - last access time
+//   uint16_t category            index into the category dictionary of the block
+//   uint8_t  key_size
+//   uint8_t  slab_id
+// then dict_size bytes of the category dictionary, category_cnt names each prefixed by a uint8_t
+// length, and key_heap_size bytes of the keys back to back, split by the key_size column.
+// All the numbers are in the byte order of the machine that wrote the dump.
+const char kColumnarMagic[8] = {'M', 'C', 'I', 'C', 'O', 'L', 'B', '\0'};
+const uint32_t kColumnarVersion = 1;
+// items of a full block, a block is cut earlier when its dictionary runs out of indexes
+const uint32_t kColumnarBlockItems = 64 * 1024;
+const uint32_t kColumnarMaxCategories = 64 * 1024;
+
+struct ColumnarBlockHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t item_cnt;
+  uint32_t category_cnt;
+  uint32_t dict_size;
+  uint32_t key_heap_size;
+  uint32_t reserved;
+};
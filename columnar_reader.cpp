@@ -0,0 +1,117 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "columnar_reader.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <stdexcept>
+
+
+using namespace std;
+
+
+ColumnarReader::ColumnarReader(const string &filename): corrupted_(false) {
+  file_ = gzopen(filename.c_str(), "rb");
+  if (!file_) {
+    throw runtime_error("file open failed: " + filename + " Error: " + strerror(errno));
+  }
+}
+
+
+ColumnarReader::~ColumnarReader() {
+  gzclose(file_);
+}
+
+
+template <typename T>
+bool ColumnarReader::read_column(vector<T> *column, uint32_t cnt) {
+  column->resize(cnt);
+  return read_bytes(column->data(), sizeof(T) * cnt);
+}
+
+
+bool ColumnarReader::read_bytes(void *dest, size_t len) {
+  // blocks are at most 17MB, well in the range of one gzread
+  return gzread(file_, dest, len) == int(len);
+}
+
+
+bool ColumnarReader::next_block() {
+  cas.clear();
+  categories.clear();
+  keys.clear();
+  if (corrupted_) {
+    return false;
+  }
+  int c = gzgetc(file_);
+  if (c == -1) {
+    return false;
+  }
+  gzungetc(c, file_);
+  if (!read_block()) {
+    corrupted_ = true;
+    cas.clear();
+    return false;
+  }
+  return true;
+}
+
+
+bool ColumnarReader::read_block() {
+  ColumnarBlockHeader header;
+  if (!read_bytes(&header, sizeof(header))
+      || memcmp(header.magic, kColumnarMagic, sizeof(header.magic))
+      || header.version != kColumnarVersion
+      || header.item_cnt > kColumnarBlockItems
+      || header.category_cnt > kColumnarMaxCategories) {
+    return false;
+  }
+  uint32_t cnt = header.item_cnt;
+  if (!read_column(&cas, cnt)
+      || !read_column(&val_size, cnt)
+      || !read_column(&expire_in_secs, cnt)
+      || !read_column(&last_touch_secs_ago, cnt)
+      || !read_column(&category, cnt)
+      || !read_column(&key_size, cnt)
+      || !read_column(&slab_id, cnt)) {
+    return false;
+  }
+  dict_.resize(header.dict_size);
+  key_heap_.resize(header.key_heap_size);
+  if (!read_bytes(&dict_[0], dict_.size()) || !read_bytes(&key_heap_[0], key_heap_.size())) {
+    return false;
+  }
+
+  size_t off = 0;
+  for (uint32_t i = 0; i < header.category_cnt; i++) {
+    if (off >= dict_.size() || off + 1 + uint8_t(dict_[off]) > dict_.size()) {
+      return false;
+    }
+    categories.push_back(ByteView{dict_.data() + off + 1, uint8_t(dict_[off])});
+    off += 1 + uint8_t(dict_[off]);
+  }
+  off = 0;
+  for (uint32_t i = 0; i < cnt; i++) {
+    if (category[i] >= categories.size() || off + key_size[i] > key_heap_.size()) {
+      return false;
+    }
+    keys.push_back(ByteView{key_heap_.data() + off, key_size[i]});
+    off += key_size[i];
+  }
+  return off == key_heap_.size();
+}
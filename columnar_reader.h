@@ -0,0 +1,61 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "columnar_format.h"
+#include "item_view.h"
+
+#include <stdint.h>
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+
+// Reads a columnar dump block by block, see columnar_format.h. The columns of the current block
+// are public, row i of the block is the i-th value of every column. A dump written with
+// --dump-compression=gzip is read the same way.
+class ColumnarReader {
+public:
+  explicit ColumnarReader(const std::string &filename);
+  ~ColumnarReader();
+  // Loads the next block, returns false at the end of the dump or when the block is corrupted.
+  bool next_block();
+  bool corrupted() const { return corrupted_; }
+  uint32_t size() const { return cas.size(); }
+
+  std::vector<uint64_t> cas;
+  std::vector<uint32_t> val_size;
+  std::vector<int32_t> expire_in_secs;
+  std::vector<int32_t> last_touch_secs_ago;
+  std::vector<uint16_t> category;
+  std::vector<uint8_t> key_size;
+  std::vector<uint8_t> slab_id;
+  // the views point into the block and are valid until the next call of next_block()
+  std::vector<ByteView> categories;
+  std::vector<ByteView> keys;
+
+private:
+  template <typename T>
+  bool read_column(std::vector<T> *column, uint32_t cnt);
+  bool read_block();
+  bool read_bytes(void *dest, size_t len);
+
+  gzFile file_;
+  bool corrupted_;
+  std::string dict_;
+  std::string key_heap_;
+};
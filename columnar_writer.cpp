@@ -0,0 +1,109 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "columnar_writer.h"
+
+#include <string.h>
+
+
+using namespace std;
+
+
+namespace {
+  template <typename T>
+  void write_column(FileDumper *file_dumper, const vector<T> &column) {
+    file_dumper->write_bytes(reinterpret_cast<const char *>(column.data()), column.size() * sizeof(T));
+  }
+}
+
+
+ColumnarWriter::ColumnarWriter(FileDumper *file_dumper): file_dumper_(file_dumper) {
+  cas_.reserve(kColumnarBlockItems);
+  val_size_.reserve(kColumnarBlockItems);
+  expire_in_secs_.reserve(kColumnarBlockItems);
+  last_touch_secs_ago_.reserve(kColumnarBlockItems);
+  category_.reserve(kColumnarBlockItems);
+  key_size_.reserve(kColumnarBlockItems);
+  slab_id_.reserve(kColumnarBlockItems);
+}
+
+
+void ColumnarWriter::add(unsigned int cur_time, const ItemView &item) {
+  uint32_t id = categories_.intern(item.category);
+  if (id >= block_index_.size()) {
+    block_index_.resize(id + 1, 0);
+  }
+  if (!block_index_[id]) {
+    if (block_categories_.size() == kColumnarMaxCategories) {
+      flush();
+    }
+    block_categories_.push_back(id);
+    block_index_[id] = block_categories_.size();
+    // keys are at most 250 bytes, so are their categories
+    dict_.push_back(char(item.category.size));
+    dict_.append(item.category.data, item.category.size);
+  }
+  cas_.push_back(item.cas);
+  val_size_.push_back(item.nbytes);
+  expire_in_secs_.push_back(int(item.exp_time - cur_time));
+  last_touch_secs_ago_.push_back(int(cur_time - item.touch_time));
+  category_.push_back(block_index_[id] - 1);
+  key_size_.push_back(item.key.size);
+  slab_id_.push_back(item.slab_id);
+  key_heap_.append(item.key.data, item.key.size);
+  if (cas_.size() == kColumnarBlockItems) {
+    flush();
+  }
+}
+
+
+void ColumnarWriter::flush() {
+  if (cas_.empty()) {
+    return;
+  }
+  ColumnarBlockHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kColumnarMagic, sizeof(header.magic));
+  header.version = kColumnarVersion;
+  header.item_cnt = cas_.size();
+  header.category_cnt = block_categories_.size();
+  header.dict_size = dict_.size();
+  header.key_heap_size = key_heap_.size();
+  file_dumper_->write_bytes(reinterpret_cast<const char *>(&header), sizeof(header));
+  write_column(file_dumper_, cas_);
+  write_column(file_dumper_, val_size_);
+  write_column(file_dumper_, expire_in_secs_);
+  write_column(file_dumper_, last_touch_secs_ago_);
+  write_column(file_dumper_, category_);
+  write_column(file_dumper_, key_size_);
+  write_column(file_dumper_, slab_id_);
+  file_dumper_->write_bytes(dict_.data(), dict_.size());
+  file_dumper_->write_bytes(key_heap_.data(), key_heap_.size());
+
+  for (uint32_t id : block_categories_) {
+    block_index_[id] = 0;
+  }
+  block_categories_.clear();
+  cas_.clear();
+  val_size_.clear();
+  expire_in_secs_.clear();
+  last_touch_secs_ago_.clear();
+  category_.clear();
+  key_size_.clear();
+  slab_id_.clear();
+  dict_.clear();
+  key_heap_.clear();
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "category_interner.h"
+#include "columnar_format.h"
+#include "file_dumper.h"
+#include "item_view.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+// Collects the items of the item dumper into the columns of a block and writes the block when it
+// is full, see columnar_format.h. Categories are interned once per dump and mapped to the indexes
+// of the block dictionary, so adding an item does not allocate in the steady state.
+class ColumnarWriter {
+public:
+  explicit ColumnarWriter(FileDumper *file_dumper);
+  void add(unsigned int cur_time, const ItemView &item);
+  // Writes the items added since the last block, call it before the dumper is closed.
+  void flush();
+
+private:
+  FileDumper *file_dumper_;
+  CategoryInterner categories_;
+  // block dictionary index + 1 of every interned category, 0 if it is not in the block
+  std::vector<uint32_t> block_index_;
+  // interned ids of the categories in the block dictionary
+  std::vector<uint32_t> block_categories_;
+  std::vector<uint64_t> cas_;
+  std::vector<uint32_t> val_size_;
+  std::vector<int32_t> expire_in_secs_;
+  std::vector<int32_t> last_touch_secs_ago_;
+  std::vector<uint16_t> category_;
+  std::vector<uint8_t> key_size_;
+  std::vector<uint8_t> slab_id_;
+  std::string dict_;
+  std::string key_heap_;
+};
@@ -16,10 +16,53 @@
 
 #include "common.h"
 
+#include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <sstream>
+
+
+using namespace std;
 
 
 const char *is_arg(const char *arg, const char *arg_key) {
   return !strncmp(arg, arg_key, strlen(arg_key)) ? arg + strlen(arg_key) : nullptr;
 }
 
+
+vector<string> split_line(const string& line) {
+  stringstream ss(line);
+  vector<string> tokens;
+  string buf;
+  while (ss >> buf) {
+    tokens.push_back(buf);
+  }
+  return tokens;
+}
+
+
+int socket_connect(int port) {
+  struct sockaddr_in remote;
+  remote.sin_family = AF_INET;
+  remote.sin_port = htons(port);
+  memset(&remote.sin_zero, 0, 8);
+
+  remote.sin_addr.s_addr = inet_addr("127.0.0.1");
+  int sock_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (sock_fd == -1) {
+    fprintf(stderr, "socket() failed. Message: %s.\n", strerror(errno));
+    return -1;
+  }
+
+  if (connect(sock_fd, (struct sockaddr*)&remote, sizeof(struct sockaddr_in)) == -1) {
+    fprintf(stderr, "connect() to %d failed. Message: %s.\n", port, strerror(errno));
+    close(sock_fd);
+    return -1;
+  }
+  return sock_fd;
+}
@@ -15,6 +15,7 @@
  */
 
 #pragma once
+#include <string>
 #include <tuple>
 #include <vector>
 
@@ -27,3 +28,8 @@ const auto GB = 1024lu * MB;
 typedef std::vector<std::tuple<const char *, const char *, const char *>> Args;
 const char *is_arg(const char *arg, const char *arg_key);
 
+// Returns the words of a line, split at whitespace.
+std::vector<std::string> split_line(const std::string& line);
+
+// Connects to a TCP port of localhost, returns the socket or -1 on error.
+int socket_connect(int port);
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "core_memory_source.h"
+#include "common.h"
+
+#include <elf.h>
+#include <string.h>
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace {
+  struct FileMapping {
+    uint64_t lo;
+    uint64_t hi;
+    string path;
+  };
+
+  vector<FileMapping> get_file_mappings(const char *image, uint64_t image_size, const Elf64_Phdr &note) {
+    // the NT_FILE note lists the file-backed mappings: count, page size, count * (start, end, offset),
+    // then count null-terminated paths
+    vector<FileMapping> mappings;
+    uint64_t off = note.p_offset;
+    uint64_t end = min(image_size, note.p_offset + note.p_filesz);
+    while (off + sizeof(Elf64_Nhdr) <= end) {
+      auto nhdr = reinterpret_cast<const Elf64_Nhdr *>(image + off);
+      uint64_t desc_off = off + sizeof(Elf64_Nhdr) + ((nhdr->n_namesz + 3) & ~3u);
+      off = desc_off + ((nhdr->n_descsz + 3) & ~3u);
+      if (off > end) {
+        break;
+      }
+      if (nhdr->n_type != NT_FILE || nhdr->n_descsz < 2 * sizeof(uint64_t)) {
+        continue;
+      }
+      auto desc = reinterpret_cast<const uint64_t *>(image + desc_off);
+      uint64_t cnt = desc[0];
+      if ((2 + 3 * cnt) * sizeof(uint64_t) > nhdr->n_descsz) {
+        break;
+      }
+      const char *path = (const char *)(desc + 2 + 3 * cnt);
+      const char *desc_end = image + desc_off + nhdr->n_descsz;
+      for (uint64_t i = 0; i < cnt && path < desc_end; i++) {
+        string name(path, strnlen(path, desc_end - path));
+        mappings.push_back({desc[2 + 3 * i], desc[2 + 3 * i + 1], name});
+        path += name.size() + 1;
+      }
+    }
+    return mappings;
+  }
+}
+
+
+bool CoreMemorySource::load_segments() {
+  auto ehdr = reinterpret_cast<const Elf64_Ehdr *>(image_);
+  if (image_size_ < sizeof(Elf64_Ehdr) || memcmp(image_, ELFMAG, SELFMAG) || image_[EI_CLASS] != ELFCLASS64
+      || ehdr->e_type != ET_CORE || ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr) > image_size_) {
+    fprintf(stderr, "%s is not a 64-bit ELF core file\n", filename_.c_str());
+    return false;
+  }
+  auto phdrs = reinterpret_cast<const Elf64_Phdr *>(image_ + ehdr->e_phoff);
+  vector<FileMapping> file_mappings;
+  vector<const Elf64_Phdr *> loads;
+  for (int i = 0; i < ehdr->e_phnum; i++) {
+    if (phdrs[i].p_type == PT_NOTE) {
+      auto mappings = get_file_mappings(image_, image_size_, phdrs[i]);
+      file_mappings.insert(file_mappings.end(), mappings.begin(), mappings.end());
+    } else if (phdrs[i].p_type == PT_LOAD) {
+      loads.push_back(&phdrs[i]);
+    }
+  }
+  if (file_mappings.empty()) {
+    fprintf(stderr, "%s has no NT_FILE note to tell the heap from the mapped files\n", filename_.c_str());
+    return false;
+  }
+  sort(loads.begin(), loads.end(), [](const Elf64_Phdr *l, const Elf64_Phdr *r) { return l->p_vaddr < r->p_vaddr; });
+
+  // the executable is the first file that is mapped
+  const string &exe_path = file_mappings[0].path;
+  bool after_exe = false;
+  for (auto phdr : loads) {
+    const FileMapping *mapping = nullptr;
+    for (const auto &m : file_mappings) {
+      if (phdr->p_vaddr >= m.lo && phdr->p_vaddr < m.hi) {
+        mapping = &m;
+        break;
+      }
+    }
+    bool is_exe = mapping && mapping->path == exe_path;
+    bool writable = phdr->p_flags & PF_W;
+    Area area((const char *)phdr->p_vaddr, (const char *)(phdr->p_vaddr + phdr->p_memsz));
+    Segment segment = {area, phdr->p_offset, min(phdr->p_filesz, phdr->p_memsz),
+                       // same as the rw-p areas with no file in /proc/pid/maps
+                       writable && !mapping && area.size() >= 128 * KB,
+                       writable && (is_exe || (after_exe && !mapping))};
+    if (segment.is_heap || segment.is_data) {
+      segments_.push_back(segment);
+    }
+    after_exe = is_exe;
+  }
+  return true;
+}
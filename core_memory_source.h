@@ -0,0 +1,29 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include "mapped_memory_source.h"
+
+
+// Reads an ELF core file of memcached, e.g. one written by gcore or by the kernel.
+class CoreMemorySource : public MappedMemorySource {
+public:
+  explicit CoreMemorySource(const std::string &filename) : MappedMemorySource(filename) {}
+
+protected:
+  bool load_segments();
+};
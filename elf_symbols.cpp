@@ -0,0 +1,126 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "elf_symbols.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+
+
+using namespace std;
+
+
+namespace {
+  uint64_t find_symbol_value(const char *image, size_t image_size, const string &name) {
+    auto ehdr = reinterpret_cast<const Elf64_Ehdr *>(image);
+    if (ehdr->e_shoff == 0 || ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > image_size) {
+      return 0;
+    }
+    auto shdrs = reinterpret_cast<const Elf64_Shdr *>(image + ehdr->e_shoff);
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+      // static variables are only in .symtab, which strip removes
+      if ((shdrs[i].sh_type != SHT_SYMTAB && shdrs[i].sh_type != SHT_DYNSYM)
+          || shdrs[i].sh_link >= ehdr->e_shnum) {
+        continue;
+      }
+      const auto &strtab = shdrs[shdrs[i].sh_link];
+      if (shdrs[i].sh_offset + shdrs[i].sh_size > image_size
+          || strtab.sh_offset + strtab.sh_size > image_size) {
+        continue;
+      }
+      auto syms = reinterpret_cast<const Elf64_Sym *>(image + shdrs[i].sh_offset);
+      for (size_t j = 0; j < shdrs[i].sh_size / sizeof(Elf64_Sym); j++) {
+        if (syms[j].st_shndx != SHN_UNDEF
+            && syms[j].st_name < strtab.sh_size
+            && !strncmp(image + strtab.sh_offset + syms[j].st_name, name.c_str(),
+                        strtab.sh_size - syms[j].st_name)) {
+          return syms[j].st_value;
+        }
+      }
+    }
+    return 0;
+  }
+
+  uint64_t get_load_bias(pid_t pid, const char *image) {
+    auto ehdr = reinterpret_cast<const Elf64_Ehdr *>(image);
+    if (ehdr->e_type != ET_DYN) {
+      return 0;
+    }
+    // the first mapping of the executable file is its lowest PT_LOAD segment
+    char exe_path[PATH_MAX] = {0};
+    if (readlink(("/proc/" + to_string(pid) + "/exe").c_str(), exe_path, sizeof(exe_path) - 1) < 0) {
+      return 0;
+    }
+    auto phdrs = reinterpret_cast<const Elf64_Phdr *>(image + ehdr->e_phoff);
+    uint64_t first_vaddr = 0;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+      if (phdrs[i].p_type == PT_LOAD) {
+        first_vaddr = phdrs[i].p_vaddr & ~(uint64_t)(getpagesize() - 1);
+        break;
+      }
+    }
+
+    ifstream infile("/proc/" + to_string(pid) + "/maps");
+    string line;
+    while (getline(infile, line)) {
+      uint64_t lo = 0;
+      uint64_t offset = 0;
+      char path[PATH_MAX] = {0};
+      if (sscanf(line.c_str(), "%" SCNx64 "-%*x %*s %" SCNx64 " %*s %*s %4095s", &lo, &offset, path) == 3
+          && offset == 0 && !strcmp(path, exe_path)) {
+        return lo - first_vaddr;
+      }
+    }
+    return 0;
+  }
+}
+
+
+uint64_t find_process_symbol(pid_t pid, const string &name) {
+  int fd = open(("/proc/" + to_string(pid) + "/exe").c_str(), O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(Elf64_Ehdr)) {
+    close(fd);
+    return 0;
+  }
+  const char *image = (const char *)mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    return 0;
+  }
+
+  uint64_t addr = 0;
+  if (!memcmp(image, ELFMAG, SELFMAG) && image[EI_CLASS] == ELFCLASS64) {
+    addr = find_symbol_value(image, st.st_size, name);
+    if (addr) {
+      addr += get_load_bias(pid, image);
+    }
+  }
+  munmap((void *)image, st.st_size);
+  return addr;
+}
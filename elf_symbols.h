@@ -0,0 +1,27 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+
+// Looks up a symbol in the symbol tables of the executable of a running process.
+// The load address is added for position independent executables.
+// Returns 0 if the executable is stripped or has no such symbol.
+uint64_t find_process_symbol(pid_t pid, const std::string &name);
@@ -17,6 +17,10 @@
 #include "common.h"
 #include "expired_item_dumper.h"
 
+#include <unistd.h>
+
+#include <exception>
+
 
 using namespace std;
 
@@ -47,7 +51,7 @@ bool ExpiredItemDumper::init() {
   } else {
     try {
       file_dumper_.reset(new FileDumper(filename_));
-    } catch (runtime_error &e) {
+    } catch (exception &e) {
       fprintf(stderr, "%s\n", e.what());
       return false;
     }
@@ -56,15 +60,31 @@ bool ExpiredItemDumper::init() {
 }
 
 
-void ExpiredItemDumper::process_item(unsigned int cur_time,
-                                     const string &key,
-                                     const string &category,
-                                     unsigned int touch_time,
-                                     unsigned int exp_time,
-                                     unsigned int nbytes,
-                                     int slab_id,
-                                     uint64_t cas) {
-  if (exp_time && cur_time >= exp_time) {
-    file_dumper_->write(key);
+ItemProcessor *ExpiredItemDumper::clone(int worker_id) const {
+  // each clone dumps into its own part file which is appended to the main file on merge
+  auto *dumper = new ExpiredItemDumper();
+  dumper->filename_ = filename_ + ".part" + to_string(worker_id);
+  try {
+    dumper->file_dumper_.reset(new FileDumper(dumper->filename_));
+  } catch (exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    delete dumper;
+    return nullptr;
+  }
+  return dumper;
+}
+
+
+void ExpiredItemDumper::merge(ItemProcessor *other) {
+  auto *dumper = static_cast<ExpiredItemDumper *>(other);
+  dumper->file_dumper_.reset();
+  file_dumper_->append(dumper->filename_);
+  unlink(dumper->filename_.c_str());
+}
+
+
+void ExpiredItemDumper::process_item(unsigned int cur_time, const ItemView &item) {
+  if (item.exp_time && cur_time >= item.exp_time) {
+    file_dumper_->write(item.key.data, item.key.size);
   }
 }
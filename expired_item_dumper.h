@@ -28,15 +28,11 @@ class ExpiredItemDumper: public ItemProcessor {
 public:
   ExpiredItemDumper();
   bool set_arg(const char *argv);
+  int file_dumper_cnt() const { return 1; }
   bool init();
-  void process_item(unsigned int cur_time,
-                    const std::string &key,
-                    const std::string &category,
-                    unsigned int touch_time,
-                    unsigned int exp_time,
-                    unsigned int nbytes,
-                    int slab_id,
-                    uint64_t cas);
+  ItemProcessor *clone(int worker_id) const;
+  void merge(ItemProcessor *other);
+  void process_item(unsigned int cur_time, const ItemView &item);
 
 private:
   std::unique_ptr<FileDumper> file_dumper_;
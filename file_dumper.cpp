@@ -16,25 +16,222 @@
 
 #include "file_dumper.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
 
 
 using namespace std;
 
 
-FileDumper::FileDumper(const string& filename) {
-  file_.rdbuf()->pubsetbuf(buffer_, kFileWriteBufSize);
-  file_.open(filename);
-  if (file_.fail()) {
+FileDumper::FileDumper(const string& filename, DumpCompression compression):
+  filename_(filename),
+  compression_(compression),
+  free_buffers_(kBufferCnt),
+  // one more for the end marker
+  full_buffers_(kBufferCnt + 1) {
+  fd_ = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
     throw runtime_error("file open failed: " + filename + " Error: " + strerror(errno));
   }
+  cur_ = {nullptr, 0, false};
+  try {
+    for (int i = 0; i < kBufferCnt; i++) {
+      free_buffers_.push(new char[kFileWriteBufSize]);
+    }
+    cur_.data = free_buffers_.pop();
+    writer_ = thread([this] { write_loop(); });
+  } catch (exception &e) {
+    // the destructor is not run for a constructor that throws
+    delete [] cur_.data;
+    char *buffer;
+    while (free_buffers_.try_pop(&buffer)) {
+      delete [] buffer;
+    }
+    close(fd_);
+    throw runtime_error("dump writer start failed: " + filename + " Error: " + e.what());
+  }
 }
 
 FileDumper::~FileDumper() {
-  file_.close();
+  full_buffers_.push(cur_);
+  full_buffers_.push({nullptr, 0, false});
+  writer_.join();
+  for (int i = 0; i < kBufferCnt; i++) {
+    delete [] free_buffers_.pop();
+  }
+  close(fd_);
 }
 
 void FileDumper::write(const string& line) {
-  // using '\n' instead of endl because we don't want it to flush too often
-  file_ << line << '\n';
+  write(line.data(), line.size());
+}
+
+void FileDumper::write(const char *line, size_t len) {
+  if (cur_.size + len < kFileWriteBufSize) {
+    memcpy(cur_.data + cur_.size, line, len);
+    cur_.data[cur_.size + len] = '\n';
+    cur_.size += len + 1;
+  } else {
+    write_bytes(line, len);
+    write_bytes("\n", 1);
+  }
+}
+
+void FileDumper::write_bytes(const char *data, size_t len) {
+  while (len) {
+    if (cur_.size == kFileWriteBufSize) {
+      hand_over();
+    }
+    size_t n = min<size_t>(len, kFileWriteBufSize - cur_.size);
+    memcpy(cur_.data + cur_.size, data, n);
+    cur_.size += n;
+    data += n;
+    len -= n;
+  }
+}
+
+void FileDumper::append(const string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "file open failed: %s Error: %s\n", filename.c_str(), strerror(errno));
+    return;
+  }
+  if (cur_.size) {
+    hand_over();
+  }
+  for (;;) {
+    ssize_t n = read(fd, cur_.data, kFileWriteBufSize);
+    if (n <= 0) {
+      if (n < 0) {
+        fprintf(stderr, "read of %s failed: %s\n", filename.c_str(), strerror(errno));
+      }
+      break;
+    }
+    cur_.size = n;
+    cur_.raw = true;
+    hand_over();
+  }
+  close(fd);
+}
+
+void FileDumper::hand_over() {
+  full_buffers_.push(cur_);
+  cur_ = {free_buffers_.pop(), 0, false};
+}
+
+void FileDumper::write_loop() {
+  z_stream zs;
+  vector<char> out;
+  bool ok = true;
+  if (compression_ == kDumpGzip) {
+    memset(&zs, 0, sizeof(zs));
+    // the fastest level, with a gzip header so the dump can be read by zcat
+    ok = deflateInit2(&zs, 1, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    out.resize(kFileWriteBufSize);
+  }
+  // a gzip member is started for the lines before the first appended file, even if there are
+  // none, so that a dump without any line is a valid gzip file too
+  bool member_open = true;
+  auto deflate_out = [&](const char *data, size_t size, int flush) {
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = size;
+    int ret;
+    do {
+      zs.next_out = (Bytef *)&out[0];
+      zs.avail_out = out.size();
+      ret = deflate(&zs, flush);
+      if (ret == Z_STREAM_ERROR || !write_all(&out[0], out.size() - zs.avail_out)) {
+        return false;
+      }
+    } while (zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+    return true;
+  };
+
+  Buffer batch[kMaxBatch];
+  for (bool done = false; !done; ) {
+    int cnt = 0;
+    batch[cnt++] = full_buffers_.pop();
+    while (cnt < kMaxBatch && batch[cnt - 1].data && full_buffers_.try_pop(&batch[cnt])) {
+      cnt++;
+    }
+    if (!batch[cnt - 1].data) {
+      done = true;
+      cnt--;
+    }
+    if (ok && compression_ == kDumpUncompressed) {
+      ok = write_out(batch, cnt);
+    }
+    for (int i = 0; ok && compression_ == kDumpGzip && i < cnt; i++) {
+      if (!batch[i].raw) {
+        ok = deflate_out(batch[i].data, batch[i].size, Z_NO_FLUSH);
+        member_open = true;
+      } else {
+        // the appended file is a gzip stream of its own, the current member ends before it
+        if (member_open) {
+          ok = deflate_out(nullptr, 0, Z_FINISH) && deflateReset(&zs) == Z_OK;
+          member_open = false;
+        }
+        ok = ok && write_all(batch[i].data, batch[i].size);
+      }
+    }
+    // after a failure the buffers are still recycled, so the scan is never blocked
+    for (int i = 0; i < cnt; i++) {
+      free_buffers_.push(batch[i].data);
+    }
+  }
+  if (compression_ == kDumpGzip) {
+    if (ok && member_open) {
+      ok = deflate_out(nullptr, 0, Z_FINISH);
+    }
+    deflateEnd(&zs);
+  }
+  if (!ok) {
+    fprintf(stderr, "write to %s failed: %s\n", filename_.c_str(), strerror(errno));
+  }
+}
+
+bool FileDumper::write_out(const Buffer *buffers, int cnt) {
+  struct iovec iov[kMaxBatch];
+  int iov_cnt = 0;
+  for (int i = 0; i < cnt; i++) {
+    if (buffers[i].size) {
+      iov[iov_cnt].iov_base = buffers[i].data;
+      iov[iov_cnt].iov_len = buffers[i].size;
+      iov_cnt++;
+    }
+  }
+  struct iovec *next = iov;
+  while (iov_cnt) {
+    ssize_t n = writev(fd_, next, iov_cnt);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    // skip what is written, a short write can end in the middle of a buffer
+    while (iov_cnt && size_t(n) >= next->iov_len) {
+      n -= next->iov_len;
+      next++;
+      iov_cnt--;
+    }
+    if (iov_cnt) {
+      next->iov_base = (char *)next->iov_base + n;
+      next->iov_len -= n;
+    }
+  }
+  return true;
+}
+
+bool FileDumper::write_all(const char *data, size_t len) {
+  Buffer buffer = {const_cast<char *>(data), len, false};
+  return write_out(&buffer, 1);
 }
@@ -15,23 +15,68 @@
  */
 
 #pragma once
+#include "blocking_queue.h"
 #include "common.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
-#include <fstream>
 #include <string>
+#include <thread>
 
 
+enum DumpCompression {
+  kDumpUncompressed = 0,
+  // a gzip stream, the part files appended to it are gzip members of their own
+  kDumpGzip = 1,
+};
+
+
+// Writes a dump file from a background thread: the lines are copied into large buffers which the
+// writer thread compresses and writes while the scan goes on. The scan only waits when all the
+// buffers are queued for the writer, which keeps the memory bounded when the disk falls behind.
 class FileDumper {
 public:
   FileDumper() = delete;
-  FileDumper(const std::string& filename);
+  // throws runtime_error when the file can not be opened or the buffers and writer thread can not
+  // be set up
+  FileDumper(const std::string& filename, DumpCompression compression = kDumpUncompressed);
+  // writes what is buffered and closes the file
   ~FileDumper();
   void write(const std::string& line);
+  void write(const char *line, size_t len);
+  // writes the bytes as they are, without the line break
+  void write_bytes(const char *data, size_t len);
+  // copy whole content of another file to the end of this one
+  void append(const std::string& filename);
+
+  static const uint32_t kFileWriteBufSize = 1 * MB;
+  static const int kBufferCnt = 4;
+  // memory taken by the buffers of a dumper
+  static const uint64_t kBufferMemSize = kBufferCnt * kFileWriteBufSize;
 
 private:
-  static const uint32_t kFileWriteBufSize = 256 * KB;
-  char buffer_[kFileWriteBufSize];
-  std::ofstream file_;
+  struct Buffer {
+    // nullptr tells the writer thread to finish
+    char *data;
+    size_t size;
+    // the bytes of an appended file, written as they are even when compressing
+    bool raw;
+  };
+
+  // queues the current buffer for the writer and takes a free one
+  void hand_over();
+  void write_loop();
+  bool write_out(const Buffer *buffers, int cnt);
+  bool write_all(const char *data, size_t len);
+
+  // buffers written by one writev
+  static const int kMaxBatch = 16;
+  std::string filename_;
+  int fd_;
+  DumpCompression compression_;
+  Buffer cur_;
+  BlockingQueue<char *> free_buffers_;
+  BlockingQueue<Buffer> full_buffers_;
+  std::thread writer_;
 };
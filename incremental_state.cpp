@@ -0,0 +1,170 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "incremental_state.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace {
+  const char kStateMagic[8] = {'M', 'C', 'I', 'I', 'N', 'C', 'R', '\0'};
+  const uint32_t kStateVersion = 1;
+
+  struct StateHeader {
+    char magic[8];
+    uint32_t version;
+    // datafield_off, the item records are only valid with the same item layout
+    uint32_t item_header_size;
+    int64_t pid;
+    int64_t server_start_unixtime;
+    uint64_t area_cnt;
+  };
+
+  struct PageHeader {
+    uint64_t page;
+    uint32_t item_cnt;
+    uint32_t records_size;
+  };
+}
+
+
+IncrementalStateReader::~IncrementalStateReader() {
+  if (fp_) {
+    fclose(fp_);
+  }
+}
+
+
+bool IncrementalStateReader::open(const string &filename, pid_t pid, time_t server_start_unixtime,
+                                  uint32_t item_header_size) {
+  fp_ = fopen(filename.c_str(), "rb");
+  if (!fp_) {
+    return false;
+  }
+  StateHeader header;
+  if (fread(&header, sizeof(header), 1, fp_) != 1
+      || memcmp(header.magic, kStateMagic, sizeof(kStateMagic))
+      || header.version != kStateVersion
+      || header.item_header_size != item_header_size
+      || header.pid != pid
+      || header.server_start_unixtime != server_start_unixtime) {
+    return false;
+  }
+  vector<uint64_t> bounds(header.area_cnt * 2);
+  if (fread(bounds.data(), sizeof(uint64_t), bounds.size(), fp_) != bounds.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < bounds.size(); i += 2) {
+    area_list_.emplace_back((const char *)bounds[i], (const char *)bounds[i + 1]);
+  }
+  eof_ = false;
+  read_next();
+  return true;
+}
+
+
+bool IncrementalStateReader::covered(uint64_t page) const {
+  Area needle = {(const char *)page, (const char *)page};
+  auto it = lower_bound(area_list_.begin(), area_list_.end(), needle);
+  return it != area_list_.end() && (const char *)page >= it->lo;
+}
+
+
+bool IncrementalStateReader::read_next() {
+  PageHeader header;
+  if (eof_ || fread(&header, sizeof(header), 1, fp_) != 1) {
+    eof_ = true;
+    return false;
+  }
+  next_.page = header.page;
+  next_.item_cnt = header.item_cnt;
+  next_.records.resize(header.records_size);
+  if (header.records_size && fread(&next_.records[0], 1, header.records_size, fp_) != header.records_size) {
+    eof_ = true;
+    return false;
+  }
+  return true;
+}
+
+
+void IncrementalStateReader::read_pages(uint64_t lo, uint64_t hi, vector<PageItems> *pages) {
+  for (; !eof_ && next_.page < hi; read_next()) {
+    if (next_.page >= lo) {
+      pages->push_back(move(next_));
+    }
+  }
+}
+
+
+IncrementalStateWriter::~IncrementalStateWriter() {
+  if (fp_) {
+    fclose(fp_);
+    unlink((filename_ + ".tmp").c_str());
+  }
+}
+
+
+bool IncrementalStateWriter::open(const string &filename, pid_t pid, time_t server_start_unixtime,
+                                  uint32_t item_header_size, const vector<Area> &area_list) {
+  filename_ = filename;
+  fp_ = fopen((filename_ + ".tmp").c_str(), "wb");
+  if (!fp_) {
+    fprintf(stderr, "Can not open %s.tmp: %s\n", filename_.c_str(), strerror(errno));
+    return false;
+  }
+  StateHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kStateMagic, sizeof(kStateMagic));
+  header.version = kStateVersion;
+  header.item_header_size = item_header_size;
+  header.pid = pid;
+  header.server_start_unixtime = server_start_unixtime;
+  header.area_cnt = area_list.size();
+  vector<uint64_t> bounds;
+  for (const auto &area : area_list) {
+    bounds.push_back((uint64_t)area.lo);
+    bounds.push_back((uint64_t)area.hi);
+  }
+  return fwrite(&header, sizeof(header), 1, fp_) == 1
+    && fwrite(bounds.data(), sizeof(uint64_t), bounds.size(), fp_) == bounds.size();
+}
+
+
+bool IncrementalStateWriter::add_page(const PageItems &page) {
+  PageHeader header = {page.page, page.item_cnt, (uint32_t)page.records.size()};
+  return fwrite(&header, sizeof(header), 1, fp_) == 1
+    && fwrite(page.records.data(), 1, page.records.size(), fp_) == page.records.size();
+}
+
+
+bool IncrementalStateWriter::close() {
+  FILE *fp = fp_;
+  fp_ = nullptr;
+  if (fclose(fp) != 0 || rename((filename_ + ".tmp").c_str(), filename_.c_str()) != 0) {
+    fprintf(stderr, "Failed to write %s: %s\n", filename_.c_str(), strerror(errno));
+    unlink((filename_ + ".tmp").c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include "memory_source.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+
+// Items found on every page by the previous --incremental scan, so pages memcached has not
+// written since then do not need to be read again.
+// The file has a header, the areas that were scanned, then the pages with items by ascending address.
+struct PageItems {
+  uint64_t page;
+  uint32_t item_cnt;
+  // item_cnt records, each a uint16_t length then the item header and key copied from memcached
+  std::string records;
+};
+
+
+class IncrementalStateReader {
+public:
+  IncrementalStateReader() : fp_(nullptr), next_({0, 0, ""}), eof_(true) {}
+  ~IncrementalStateReader();
+
+  // Returns false if there is no state, or it was not written for this memcached process.
+  bool open(const std::string &filename, pid_t pid, time_t server_start_unixtime, uint32_t item_header_size);
+  // Whether the previous scan read the page.
+  bool covered(uint64_t page) const;
+  // Appends the pages in [lo, hi) to pages, skipping the ones before lo.
+  // It has to be called with increasing ranges.
+  void read_pages(uint64_t lo, uint64_t hi, std::vector<PageItems> *pages);
+
+private:
+  bool read_next();
+
+  FILE *fp_;
+  std::vector<Area> area_list_;
+  PageItems next_;
+  bool eof_;
+};
+
+
+class IncrementalStateWriter {
+public:
+  IncrementalStateWriter() : fp_(nullptr) {}
+  ~IncrementalStateWriter();
+
+  // The file is written under a temporary name and renamed by close(), so a failed scan
+  // leaves the previous state in place.
+  bool open(const std::string &filename, pid_t pid, time_t server_start_unixtime, uint32_t item_header_size,
+            const std::vector<Area> &area_list);
+  // Pages have to be added by ascending address.
+  bool add_page(const PageItems &page);
+  bool close();
+
+private:
+  std::string filename_;
+  FILE *fp_;
+};
@@ -16,15 +16,29 @@
 
 #include "item_aggregator.h"
 
+#include <math.h>
+
+#include <algorithm>
+
 
 using namespace std;
 
 
+const char *ItemAggregator::kOtherCategory = "__OTHER__";
+
 ItemAggregator::ItemAggregator(SlabInfo *slabs_info, int max_slab_id) {
   slabs_info_ = slabs_info;
   max_slab_id_ = max_slab_id;
   min_cat_rec_num_ = 100;
   min_cat_size_ = MB;
+  max_categories_ = 0;
+  folded_cnt_ = 0;
+  sampled_units_ = 0;
+  total_units_ = 0;
+  group_name_ = "category";
+  row_label_ = "CATEGORY";
+  quantile_row_label_ = "QUANTILES";
+  show_slabs_ = true;
 
   processor_summary_ = "Get a summary of all items in the pool";
   processor_name_ = "item aggregator";
@@ -33,7 +47,18 @@ ItemAggregator::ItemAggregator(SlabInfo *slabs_info, int max_slab_id) {
 }
 
 
-ItemAggregator::~ItemAggregator() {
+void ItemAggregator::finish() {
+  // with a sample every sampled unit stands for total_units_ / sampled_units_ units
+  bool sampled = sampled_units_ > 1 && sampled_units_ < total_units_;
+  double scale = sampled ? total_units_ * 1.0 / sampled_units_ : 1;
+  if (sampled) {
+    printf("Estimated from %lu of %lu memory units (%.2f%%), shown as estimate+-95%%_confidence_interval\n",
+           sampled_units_, total_units_, sampled_units_ * 100.0 / total_units_);
+  }
+  if (folded_cnt_) {
+    printf("%lu items beyond the first %lu %ss are counted under %s\n",
+           folded_cnt_, max_categories_, group_name_, kOtherCategory);
+  }
   printf("key\t"
          "Count\t"
          "avg_key_size\t"
@@ -47,23 +72,72 @@ ItemAggregator::~ItemAggregator() {
          "avg_ttl\t"
          "%%_of_expired\n");
 
-  for (auto it: stats_) {
-    if ((it.second.key_cnt < min_cat_rec_num_) && (it.second.mem_used_total < min_cat_size_)) {
+  for (uint32_t id = 0; id < stats_.size(); id++) {
+    const auto &stats = stats_[id];
+    const auto &name = categories_.name(id);
+    if (!is_shown(stats, scale)) {
+      continue;
+    }
+    if (sampled) {
+      printf("%s %.*s\t%.0f+-%.0f\t%.1f+-%.1f\t%.1f+-%.1f\t%.0f+-%.0f\t%.1f+-%.1f\t%.1f+-%.1f\t%.1f+-%.1f\t"
+             "%d+-%d\t%d\t%d\t%.1f+-%.1f\n",
+             row_label_, (int)name.size, name.data,
+             stats.key_cnt * scale, total_ci(stats, kKeyCnt),
+             stats.raw_keysize_total * 1.0 / stats.key_cnt, ratio_ci(stats, kKeySize),
+             stats.raw_valsize_total * 1.0 / stats.key_cnt, ratio_ci(stats, kValSize),
+             stats.mem_used_total * scale, total_ci(stats, kMemUsed),
+             stats.touch_5min_cnt * 100.0 / stats.key_cnt, ratio_ci(stats, kTouch5min) * 100,
+             stats.touch_1h_cnt * 100.0 / stats.key_cnt, ratio_ci(stats, kTouch1h) * 100,
+             stats.touch_1d_cnt * 100.0 / stats.key_cnt, ratio_ci(stats, kTouch1d) * 100,
+             int(stats.since_last_touch_total / stats.key_cnt), int(ratio_ci(stats, kSinceLastTouch)),
+             stats.idle_age.quantile(0.95),
+             int(stats.ttl_total  / (stats.key_cnt - stats.expired_cnt + 1)),
+             stats.expired_cnt * 100.0 / stats.key_cnt, ratio_ci(stats, kExpired) * 100);
+      continue;
+    }
+    printf("%s %.*s\t%lu\t%.1f\t%.1f\t%lu\t%.1f\t%.1f\t%.1f\t%d\t%d\t%d\t%.1f\n",
+           row_label_, (int)name.size, name.data,
+           stats.key_cnt,
+           stats.raw_keysize_total * 1.0 / stats.key_cnt,
+           stats.raw_valsize_total * 1.0 / stats.key_cnt,
+           stats.mem_used_total,
+           stats.touch_5min_cnt * 100.0 / stats.key_cnt,
+           stats.touch_1h_cnt * 100.0 / stats.key_cnt,
+           stats.touch_1d_cnt * 100.0 / stats.key_cnt,
+           int(stats.since_last_touch_total / stats.key_cnt),
+           stats.idle_age.quantile(0.95),
+           int(stats.ttl_total  / (stats.key_cnt - stats.expired_cnt + 1)),
+           stats.expired_cnt * 100.0 / stats.key_cnt);
+  }
+
+  // quantiles are of the scanned items, a sample only makes them less precise
+  static const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+  static const char *kQuantileNames[] = {"p50", "p90", "p99", "p999"};
+  static const char *kMetricNames[] = {"since_last_touched", "ttl", "val_size", "key_size"};
+  printf("\nQuantiles per %s, within %.1f%%: \n", group_name_, 100.0 / (2 * QuantileSketch::kSubBucketCnt));
+  printf("key");
+  for (auto metric : kMetricNames) {
+    for (auto quantile : kQuantileNames) {
+      printf("\t%s_%s", quantile, metric);
+    }
+  }
+  printf("\n");
+  for (uint32_t id = 0; id < stats_.size(); id++) {
+    const auto &stats = stats_[id];
+    const auto &name = categories_.name(id);
+    if (!is_shown(stats, scale)) {
       continue;
     }
-    printf("CATEGORY %s\t%lu\t%.1f\t%.1f\t%lu\t%.1f\t%.1f\t%.1f\t%d\t%d\t%d\t%.1f\n",
-           it.first.c_str(),
-           it.second.key_cnt,
-           it.second.raw_keysize_total * 1.0 / it.second.key_cnt,
-           it.second.raw_valsize_total * 1.0 / it.second.key_cnt,
-           it.second.mem_used_total,
-           it.second.touch_5min_cnt * 100.0 / it.second.key_cnt,
-           it.second.touch_1h_cnt * 100.0 / it.second.key_cnt,
-           it.second.touch_1d_cnt * 100.0 / it.second.key_cnt,
-           int(it.second.since_last_touch_total / it.second.key_cnt),
-           it.second.age_p95.top(),
-           int(it.second.ttl_total  / (it.second.key_cnt - it.second.expired_cnt + 1)),
-           it.second.expired_cnt * 100.0 / it.second.key_cnt);
+    printf("%s %.*s", quantile_row_label_, (int)name.size, name.data);
+    for (const auto *sketch : {&stats.idle_age, &stats.ttl_left, &stats.val_size, &stats.key_size}) {
+      for (double q : kQuantiles) {
+        printf("\t%u", sketch->quantile(q));
+      }
+    }
+    printf("\n");
+  }
+  if (!show_slabs_) {
+    return;
   }
   printf("\nOldest item touched per slab: \n");
   printf("slab_id\t"
@@ -97,48 +171,159 @@ bool ItemAggregator::set_arg(const char *argv) {
 }
 
 
-void ItemAggregator::process_item(unsigned int cur_time,
-                                  const string &key,
-                                  const string &category,
-                                  unsigned int touch_time,
-                                  unsigned int exp_time,
-                                  unsigned int nbytes,
-                                  int slab_id, uint64_t cas) {
-  if (category.empty()) {
+ItemProcessor *ItemAggregator::clone(int worker_id) const {
+  auto *aggregator = new ItemAggregator(slabs_info_, max_slab_id_);
+  copy_options(aggregator);
+  return aggregator;
+}
+
+
+void ItemAggregator::copy_options(ItemAggregator *other) const {
+  other->min_cat_rec_num_ = min_cat_rec_num_;
+  other->min_cat_size_ = min_cat_size_;
+  other->max_categories_ = max_categories_;
+}
+
+
+void ItemAggregator::merge(ItemProcessor *other) {
+  auto *aggregator = static_cast<ItemAggregator *>(other);
+  for (uint32_t other_id = 0; other_id < aggregator->stats_.size(); other_id++) {
+    auto &other_stats = aggregator->stats_[other_id];
+    // the items of the other's kOtherCategory are in its folded_cnt_ already
+    const auto &name = aggregator->categories_.name(other_id);
+    auto &category_stats = stats_[intern_category(name, name == kOtherCategory ? 0 : other_stats.key_cnt)];
+    category_stats.raw_valsize_total += other_stats.raw_valsize_total;
+    category_stats.raw_keysize_total += other_stats.raw_keysize_total;
+    category_stats.mem_used_total += other_stats.mem_used_total;
+    category_stats.touch_5min_cnt += other_stats.touch_5min_cnt;
+    category_stats.touch_1h_cnt += other_stats.touch_1h_cnt;
+    category_stats.touch_1d_cnt += other_stats.touch_1d_cnt;
+    category_stats.since_last_touch_total += other_stats.since_last_touch_total;
+    category_stats.ttl_total += other_stats.ttl_total;
+    category_stats.expired_cnt += other_stats.expired_cnt;
+    category_stats.key_cnt += other_stats.key_cnt;
+    for (int m = 0; m < kSampledMetricCnt; m++) {
+      category_stats.unit_sum_sq[m] += other_stats.unit_sum_sq[m];
+      category_stats.unit_sum_cross[m] += other_stats.unit_sum_cross[m];
+    }
+    category_stats.unit_start = category_stats.sampled_metrics();
+    category_stats.idle_age.merge(other_stats.idle_age);
+    category_stats.ttl_left.merge(other_stats.ttl_left);
+    category_stats.val_size.merge(other_stats.val_size);
+    category_stats.key_size.merge(other_stats.key_size);
+  }
+  folded_cnt_ += aggregator->folded_cnt_;
+}
+
+
+bool ItemAggregator::is_shown(const CategoryStats &stats, double scale) const {
+  return stats.key_cnt * scale >= min_cat_rec_num_ || stats.mem_used_total * scale >= min_cat_size_;
+}
+
+
+uint32_t ItemAggregator::intern_category(const ByteView &category, uint64_t key_cnt) {
+  uint32_t id;
+  if (max_categories_ && categories_.size() >= max_categories_) {
+    int64_t kept_id = categories_.find(category);
+    if (kept_id >= 0) {
+      return kept_id;
+    }
+    folded_cnt_ += key_cnt;
+    id = categories_.intern(ByteView{kOtherCategory, strlen(kOtherCategory)});
+  } else {
+    id = categories_.intern(category);
+  }
+  if (id == stats_.size()) {
+    stats_.emplace_back();
+  }
+  return id;
+}
+
+
+void ItemAggregator::end_sample_unit() {
+  for (auto id : sample_unit_categories_) {
+    auto *category_stats = &stats_[id];
+    auto metrics = category_stats->sampled_metrics();
+    uint64_t unit_key_cnt = metrics[kKeyCnt] - category_stats->unit_start[kKeyCnt];
+    for (int m = 0; m < kSampledMetricCnt; m++) {
+      double unit_value = metrics[m] - category_stats->unit_start[m];
+      category_stats->unit_sum_sq[m] += unit_value * unit_value;
+      category_stats->unit_sum_cross[m] += unit_value * unit_key_cnt;
+    }
+    category_stats->unit_start = metrics;
+    category_stats->in_sample_unit = false;
+  }
+  sample_unit_categories_.clear();
+}
+
+
+void ItemAggregator::set_sample_size(uint64_t sampled_units, uint64_t total_units) {
+  sampled_units_ = sampled_units;
+  total_units_ = total_units;
+}
+
+
+double ItemAggregator::total_ci(const CategoryStats &stats, int metric) const {
+  // units are treated as a simple random sample without replacement, a category missing from a
+  // unit counts as 0 there. se(total) = N * sqrt((1 - n/N) * s^2 / n)
+  double n = sampled_units_;
+  double sum = stats.sampled_metrics()[metric];
+  double variance = max(0.0, (stats.unit_sum_sq[metric] - sum * sum / n) / (n - 1));
+  return 1.96 * total_units_ * sqrt((1 - n / total_units_) * variance / n);
+}
+
+
+double ItemAggregator::ratio_ci(const CategoryStats &stats, int metric) const {
+  // ratio estimator r = sum(y) / sum(x) with x = key_cnt of a unit,
+  // se(r) = sqrt((1 - n/N) / n) * s_d / mean(x), with s_d^2 the variance of y - r * x
+  double n = sampled_units_;
+  auto metrics = stats.sampled_metrics();
+  double key_cnt = metrics[kKeyCnt];
+  double ratio = metrics[metric] / key_cnt;
+  double residual_sq = stats.unit_sum_sq[metric]
+    - 2 * ratio * stats.unit_sum_cross[metric]
+    + ratio * ratio * stats.unit_sum_sq[kKeyCnt];
+  double variance = max(0.0, residual_sq / (n - 1));
+  return 1.96 * sqrt((1 - n / total_units_) / n * variance) / (key_cnt / n);
+}
+
+
+void ItemAggregator::process_item(unsigned int cur_time, const ItemView &item) {
+  if (item.category.empty()) {
     return;
   }
 
-  auto &category_stats = stats_[category];
-  category_stats.raw_valsize_total += nbytes;
-  category_stats.raw_keysize_total += key.size();
+  uint32_t id = intern_category(item.category, 1);
+  auto &category_stats = stats_[id];
+  if (!category_stats.in_sample_unit) {
+    category_stats.in_sample_unit = true;
+    sample_unit_categories_.push_back(id);
+  }
+  category_stats.raw_valsize_total += item.nbytes;
+  category_stats.raw_keysize_total += item.key.size;
   category_stats.key_cnt++;
-  category_stats.mem_used_total += slabs_info_[slab_id].unit_size;
+  category_stats.mem_used_total += slabs_info_[item.slab_id].unit_size;
 
-  if (touch_time + 5 * 60 >= cur_time) {
+  if (item.touch_time + 5 * 60 >= cur_time) {
     category_stats.touch_5min_cnt++;
   }
-  if (touch_time + 60 * 60 >= cur_time) {
+  if (item.touch_time + 60 * 60 >= cur_time) {
     category_stats.touch_1h_cnt++;
   }
-  if (touch_time + 24 * 60 * 60 >= cur_time) {
+  if (item.touch_time + 24 * 60 * 60 >= cur_time) {
     category_stats.touch_1d_cnt++;
   }
 
-  int secs_touched_ago = cur_time - touch_time;
+  int secs_touched_ago = cur_time - item.touch_time;
   category_stats.since_last_touch_total += secs_touched_ago;
-  auto &age_p95 = category_stats.age_p95;
-  if (age_p95.size() < 10 || age_p95.size() < category_stats.key_cnt * 5 / 100) {
-    age_p95.push(secs_touched_ago);
-  } else {
-    if (age_p95.top() < secs_touched_ago) {
-      age_p95.push(secs_touched_ago);
-      age_p95.pop();
-    }
-  }
+  category_stats.idle_age.add(max(0, secs_touched_ago));
+  category_stats.val_size.add(item.nbytes);
+  category_stats.key_size.add(item.key.size);
 
-  if (cur_time < exp_time) {
-    category_stats.ttl_total += exp_time - cur_time;
-  } else if (exp_time) {
+  if (cur_time < item.exp_time) {
+    category_stats.ttl_total += item.exp_time - cur_time;
+    category_stats.ttl_left.add(item.exp_time - cur_time);
+  } else if (item.exp_time) {
     category_stats.expired_cnt++;
   }
 }
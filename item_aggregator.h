@@ -15,15 +15,17 @@
  */
 
 #pragma once
+#include "category_interner.h"
 #include "common.h"
 #include "item_processor.h"
+#include "quantile_sketch.h"
 
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-#include <queue>
-#include <unordered_map>
+#include <array>
+#include <vector>
 
 
 struct SlabInfo {
@@ -40,17 +42,48 @@ struct SlabInfo {
 class ItemAggregator: public ItemProcessor {
 public:
   ItemAggregator(SlabInfo *slabs_info, int max_slab_id);
-  ~ItemAggregator();
   bool set_arg(const char *argv);
-  void process_item(unsigned int cur_time,
-                    const std::string &key,
-                    const std::string &category,
-                    unsigned int touch_time,
-                    unsigned int exp_time,
-                    unsigned int nbytes,
-                    int slab_id, uint64_t cas);
+  ItemProcessor *clone(int worker_id) const;
+  void merge(ItemProcessor *other);
+  void end_sample_unit();
+  void set_sample_size(uint64_t sampled_units, uint64_t total_units);
+  void finish();
+  void process_item(unsigned int cur_time, const ItemView &item);
+
+protected:
+  // copies the options into a clone
+  void copy_options(ItemAggregator *other) const;
+
+  // what a group of keys is called, and the first words of the lines of its stats and quantiles
+  const char *group_name_;
+  const char *row_label_;
+  const char *quantile_row_label_;
+  SlabInfo *slabs_info_;
+  int max_slab_id_;
+  // print the oldest item of every slab class after the categories
+  bool show_slabs_;
+  uint64_t min_cat_rec_num_;
+  uint64_t min_cat_size_;
+  // number of categories kept apart, the items of any other one are counted under
+  // kOtherCategory. 0 for no limit
+  size_t max_categories_;
+  static const char *kOtherCategory;
 
 private:
+  // stats that are estimated with a confidence interval when only a sample is scanned
+  enum SampledMetric {
+    kKeyCnt,
+    kKeySize,
+    kValSize,
+    kMemUsed,
+    kTouch5min,
+    kTouch1h,
+    kTouch1d,
+    kSinceLastTouch,
+    kExpired,
+    kSampledMetricCnt,
+  };
+
   struct CategoryStats {
     // basic stats unit of a key category
     CategoryStats():
@@ -63,7 +96,16 @@ private:
       since_last_touch_total(0),
       ttl_total(0),
       expired_cnt(0),
-      key_cnt(0) {
+      key_cnt(0),
+      in_sample_unit(false),
+      unit_start(),
+      unit_sum_sq(),
+      unit_sum_cross() {
+    }
+
+    std::array<uint64_t, kSampledMetricCnt> sampled_metrics() const {
+      return {{key_cnt, raw_keysize_total, raw_valsize_total, mem_used_total, touch_5min_cnt,
+               touch_1h_cnt, touch_1d_cnt, since_last_touch_total, expired_cnt}};
     }
 
     uint64_t raw_valsize_total;
@@ -76,12 +118,36 @@ private:
     uint64_t ttl_total;
     uint64_t expired_cnt;
     uint64_t key_cnt;
-    std::priority_queue<int> age_p95;
+    // distributions of secs since last touched, secs to live of items that expire and are not
+    // expired yet, and of value and key sizes
+    QuantileSketch idle_age;
+    QuantileSketch ttl_left;
+    QuantileSketch val_size;
+    QuantileSketch key_size;
+
+    // for the variance between sample units: the metrics when the current unit started, and the
+    // sums over all units of the square of a metric's value in the unit and of its product with
+    // the key_cnt in the unit
+    bool in_sample_unit;
+    std::array<uint64_t, kSampledMetricCnt> unit_start;
+    std::array<double, kSampledMetricCnt> unit_sum_sq;
+    std::array<double, kSampledMetricCnt> unit_sum_cross;
   };
 
-  SlabInfo *slabs_info_;
-  std::unordered_map<std::string, CategoryStats> stats_;
-  int max_slab_id_;
-  uint64_t min_cat_rec_num_;
-  uint64_t min_cat_size_;
+  // whether the category has enough keys or memory to be reported
+  bool is_shown(const CategoryStats &stats, double scale) const;
+  // id of the category, with its stats added when it is new. Once max_categories_ are kept a new
+  // category is folded into kOtherCategory and its key_cnt items are counted as folded
+  uint32_t intern_category(const ByteView &category, uint64_t key_cnt);
+  // half width of the 95% confidence interval of the estimated total, and of the ratio to key_cnt
+  double total_ci(const CategoryStats &stats, int metric) const;
+  double ratio_ci(const CategoryStats &stats, int metric) const;
+
+  // stats_[id] are the stats of the category with that id in categories_
+  CategoryInterner categories_;
+  std::vector<CategoryStats> stats_;
+  std::vector<uint32_t> sample_unit_categories_;
+  uint64_t folded_cnt_;
+  uint64_t sampled_units_;
+  uint64_t total_units_;
 };
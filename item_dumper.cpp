@@ -16,14 +16,43 @@
 
 #include "common.h"
 #include "item_dumper.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include <exception>
 #include <fstream>
 
 
 using namespace std;
 
 
+namespace {
+  void append_uint(string *s, uint64_t val) {
+    char buf[20];
+    int i = sizeof(buf);
+    do {
+      buf[--i] = '0' + val % 10;
+      val /= 10;
+    } while (val);
+    s->append(buf + i, sizeof(buf) - i);
+  }
+
+  void append_int(string *s, int64_t val) {
+    if (val < 0) {
+      s->push_back('-');
+      append_uint(s, -(uint64_t)val);
+    } else {
+      append_uint(s, val);
+    }
+  }
+}
+
+
 ItemDumper::ItemDumper(): 
   file_dumper_(nullptr),
+  columnar_(false),
+  compression_(kDumpUncompressed),
   cas_min_(0),
   cas_max_(numeric_limits<uint64_t>::max()),
   size_min_(0),
@@ -33,6 +62,8 @@ ItemDumper::ItemDumper():
   args_.emplace_back("--category-to-dump=$CATEGORY_NAME", "category filter, multiple of this arguments is allowed", "(ALL IF NOT SPECIFIED)");
   args_.emplace_back("--category-to-dump-list=$FILE_NAME", "category filter from file while each line is a category", "(NOT SPECIFIED)");
   args_.emplace_back("--category-dump-file=$FILE_NAME", "file name to dump into", "(REQUIRED)");
+  args_.emplace_back("--dump-format=text|columnar", "text lines, or blocks of binary columns to be read by mcdumpreader", "text");
+  args_.emplace_back("--dump-compression=none|gzip", "gzip the dump file while it is written", "none");
   args_.emplace_back("--dump-cas-min=$CAS_VALUE", "Min CAS version of items to be dumped", "0");
   args_.emplace_back("--dump-cas-max=$CAS_VALUE", "Max CAS version of items to be dumped", "uint64_max");
   args_.emplace_back("--dump-size-min=$BYTES", "Min size(key len + val len) of items to be dumped", "0");
@@ -48,6 +79,24 @@ bool ItemDumper::set_arg(const char *argv) {
     categories_.insert(val);
   } else if ((val = is_arg(argv, "--category-to-dump-list="))) {
     categories_list_filename_ = val;
+  } else if ((val = is_arg(argv, "--dump-format="))) {
+    if (!strcmp(val, "columnar")) {
+      columnar_ = true;
+    } else if (!strcmp(val, "text")) {
+      columnar_ = false;
+    } else {
+      fprintf(stderr, "unknown dump format: %s\n", val);
+      return false;
+    }
+  } else if ((val = is_arg(argv, "--dump-compression="))) {
+    if (!strcmp(val, "gzip")) {
+      compression_ = kDumpGzip;
+    } else if (!strcmp(val, "none")) {
+      compression_ = kDumpUncompressed;
+    } else {
+      fprintf(stderr, "unknown dump compression: %s\n", val);
+      return false;
+    }
   } else if ((val = is_arg(argv, "--dump-cas-min="))) {
     cas_min_ = atol(val);
   } else if ((val = is_arg(argv, "--dump-cas-max="))) {
@@ -69,7 +118,10 @@ bool ItemDumper::init() {
     return false;
   } else {
     try {
-      file_dumper_.reset(new FileDumper(filename_));
+      file_dumper_.reset(new FileDumper(filename_, compression_));
+      if (columnar_) {
+        columnar_writer_.reset(new ColumnarWriter(file_dumper_.get()));
+      }
       if (!categories_list_filename_.empty()) {
         string line;
         // categories list file is specified
@@ -78,7 +130,7 @@ bool ItemDumper::init() {
           categories_.insert(line);
         }
       }
-    } catch (runtime_error &e) {
+    } catch (exception &e) {
       fprintf(stderr, "%s\n", e.what());
       return false;
     }
@@ -87,23 +139,84 @@ bool ItemDumper::init() {
 }
 
 
-void ItemDumper::process_item(unsigned int cur_time,
-                              const string &key,
-                              const string &category,
-                              unsigned int touch_time,
-                              unsigned int exp_time,
-                              unsigned int nbytes,
-                              int slab_id,
-                              uint64_t cas) {
-  if ((categories_.empty() || categories_.count(category))
-      && cas >= cas_min_
-      && cas <= cas_max_
-      && key.size() + nbytes >= size_min_
-      && key.size() + nbytes <= size_max_) {
-    static const int kLineSize = 1024;  // output line length limit
-    char buf[kLineSize];
-    snprintf(buf, kLineSize, "%s keysize: %d valsize: %d expire_in_secs: %d last_touch_secs_ago: %d cas: %" PRIu64,
-             key.c_str(), (int)key.size(), nbytes, exp_time - cur_time, cur_time - touch_time, cas);
-    file_dumper_->write(buf);
+ItemProcessor *ItemDumper::clone(int worker_id) const {
+  // each clone dumps into its own part file which is appended to the main file on merge
+  auto *dumper = new ItemDumper();
+  dumper->filename_ = filename_ + ".part" + to_string(worker_id);
+  dumper->categories_ = categories_;
+  dumper->cas_min_ = cas_min_;
+  dumper->cas_max_ = cas_max_;
+  dumper->size_min_ = size_min_;
+  dumper->size_max_ = size_max_;
+  dumper->columnar_ = columnar_;
+  dumper->compression_ = compression_;
+  try {
+    dumper->file_dumper_.reset(new FileDumper(dumper->filename_, compression_));
+    if (columnar_) {
+      dumper->columnar_writer_.reset(new ColumnarWriter(dumper->file_dumper_.get()));
+    }
+  } catch (exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    delete dumper;
+    return nullptr;
+  }
+  return dumper;
+}
+
+
+void ItemDumper::merge(ItemProcessor *other) {
+  auto *dumper = static_cast<ItemDumper *>(other);
+  // columnar blocks are self-contained, so the part files are appended like text lines
+  if (dumper->columnar_writer_) {
+    dumper->columnar_writer_->flush();
+  }
+  dumper->file_dumper_.reset();
+  file_dumper_->append(dumper->filename_);
+  unlink(dumper->filename_.c_str());
+}
+
+
+void ItemDumper::finish() {
+  if (columnar_writer_) {
+    columnar_writer_->flush();
+  }
+}
+
+
+bool ItemDumper::is_selected(const ItemView &item) {
+  if (item.cas < cas_min_
+      || item.cas > cas_max_
+      || item.key.size + item.nbytes < size_min_
+      || item.key.size + item.nbytes > size_max_) {
+    return false;
+  }
+  if (categories_.empty()) {
+    return true;
+  }
+  category_.assign(item.category.data, item.category.size);
+  return categories_.count(category_);
+}
+
+
+void ItemDumper::process_item(unsigned int cur_time, const ItemView &item) {
+  if (!is_selected(item)) {
+    return;
+  }
+  if (columnar_writer_) {
+    columnar_writer_->add(cur_time, item);
+    return;
   }
+  // "$KEY keysize: %d valsize: %d expire_in_secs: %d last_touch_secs_ago: %d cas: %lu"
+  line_.assign(item.key.data, item.key.size);
+  line_.append(" keysize: ");
+  append_int(&line_, item.key.size);
+  line_.append(" valsize: ");
+  append_int(&line_, item.nbytes);
+  line_.append(" expire_in_secs: ");
+  append_int(&line_, int(item.exp_time - cur_time));
+  line_.append(" last_touch_secs_ago: ");
+  append_int(&line_, int(cur_time - item.touch_time));
+  line_.append(" cas: ");
+  append_uint(&line_, item.cas);
+  file_dumper_->write(line_);
 }
@@ -15,6 +15,7 @@
  */
 
 #pragma once
+#include "columnar_writer.h"
 #include "file_dumper.h"
 #include "item_processor.h"
 
@@ -31,21 +32,28 @@ class ItemDumper: public ItemProcessor {
 public:
   ItemDumper();
   bool set_arg(const char *argv);
+  int file_dumper_cnt() const { return 1; }
   bool init();
-  void process_item(unsigned int cur_time,
-                    const std::string &key,
-                    const std::string &category,
-                    unsigned int touch_time,
-                    unsigned int exp_time,
-                    unsigned int nbytes,
-                    int slab_id,
-                    uint64_t cas);
+  ItemProcessor *clone(int worker_id) const;
+  void merge(ItemProcessor *other);
+  void finish();
+  void process_item(unsigned int cur_time, const ItemView &item);
 
 private:
+  // the filters of category, cas and size
+  bool is_selected(const ItemView &item);
+
   static const int kDefaultMaxItemSize = 16 * MB;
   std::unique_ptr<FileDumper> file_dumper_;
+  // set with --dump-format=columnar, the items go to it instead of text lines
+  std::unique_ptr<ColumnarWriter> columnar_writer_;
+  bool columnar_;
+  DumpCompression compression_;
   std::string filename_;
   std::unordered_set<std::string> categories_;
+  // reused for every item so neither the category filter nor the line allocate
+  std::string category_;
+  std::string line_;
   std::string categories_list_filename_;
   uint64_t cas_min_;
   uint64_t cas_max_;
@@ -0,0 +1,315 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "item_filter.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <limits>
+
+
+using namespace std;
+
+
+namespace {
+  // in the order of ItemFilter::Field
+  const char *const kFieldNames[] = {"key", "category", "slab", "keysize", "valsize", "size", "ttl", "idle", "cas"};
+
+  // longer operators first, so "<=" is not taken for "<"
+  const char *const kCompareOps[] = {"<=", ">=", "!=", "=", "<", ">"};
+  const char *const kMatchOps[] = {"^=", "$=", "*="};
+}
+
+
+bool ItemFilter::compile(const string &expr) {
+  expr_ = expr;
+  pos_ = 0;
+  error_.clear();
+  pattern_sets_.clear();
+  header_program_.clear();
+  key_program_.clear();
+  auto root = parse_or();
+  skip_space();
+  if (root && pos_ < expr_.size()) {
+    error_ = "unexpected '" + expr_.substr(pos_) + "'";
+    root.reset();
+  }
+  if (!root) {
+    fprintf(stderr, "--where: %s at column %zu of: %s\n", error_.c_str(), pos_ + 1, expr_.c_str());
+    return false;
+  }
+
+  vector<const Node *> conjuncts;
+  split_conjuncts(root.get(), &conjuncts);
+  for (auto *program : {&header_program_, &key_program_}) {
+    vector<size_t> jumps;
+    for (auto *conjunct : conjuncts) {
+      if (reads_key(conjunct) == (program == &key_program_)) {
+        if (!program->empty()) {
+          jumps.push_back(program->size());
+          program->push_back({kJumpIfFalse, kKey, kEq, false, 0});
+        }
+        flatten(conjunct, program);
+      }
+    }
+    for (size_t jump : jumps) {
+      (*program)[jump].value = program->size();
+    }
+  }
+  return true;
+}
+
+
+void ItemFilter::skip_space() {
+  while (pos_ < expr_.size() && isspace((unsigned char)expr_[pos_])) {
+    pos_++;
+  }
+}
+
+
+bool ItemFilter::next_is(const char *token) {
+  skip_space();
+  size_t len = strlen(token);
+  if (expr_.compare(pos_, len, token)) {
+    return false;
+  }
+  // a word ends where the next one starts, "orange" is not "or"
+  if (isalpha((unsigned char)token[0]) && pos_ + len < expr_.size() && isalnum((unsigned char)expr_[pos_ + len])) {
+    return false;
+  }
+  pos_ += len;
+  return true;
+}
+
+
+unique_ptr<ItemFilter::Node> ItemFilter::parse_or() {
+  auto node = parse_and();
+  while (node && (next_is("or") || next_is("||"))) {
+    unique_ptr<Node> parent(new Node{Node::kOr, {}, move(node), parse_and()});
+    node = parent->right ? move(parent) : nullptr;
+  }
+  return node;
+}
+
+
+unique_ptr<ItemFilter::Node> ItemFilter::parse_and() {
+  auto node = parse_not();
+  while (node && (next_is("and") || next_is("&&"))) {
+    unique_ptr<Node> parent(new Node{Node::kAnd, {}, move(node), parse_not()});
+    node = parent->right ? move(parent) : nullptr;
+  }
+  return node;
+}
+
+
+unique_ptr<ItemFilter::Node> ItemFilter::parse_not() {
+  if (next_is("not") || next_is("!")) {
+    auto operand = parse_not();
+    return operand ? unique_ptr<Node>(new Node{Node::kNot, {}, move(operand), nullptr}) : nullptr;
+  }
+  if (next_is("(")) {
+    auto node = parse_or();
+    if (node && !next_is(")")) {
+      error_ = "missing ')'";
+      return nullptr;
+    }
+    return node;
+  }
+  return parse_predicate();
+}
+
+
+unique_ptr<ItemFilter::Node> ItemFilter::parse_predicate() {
+  skip_space();
+  size_t start = pos_;
+  while (pos_ < expr_.size() && isalpha((unsigned char)expr_[pos_])) {
+    pos_++;
+  }
+  string name = expr_.substr(start, pos_ - start);
+  int field = -1;
+  for (size_t i = 0; i < sizeof(kFieldNames) / sizeof(kFieldNames[0]); i++) {
+    if (name == kFieldNames[i]) {
+      field = i;
+    }
+  }
+  if (field < 0) {
+    pos_ = start;
+    error_ = name.empty() ? "expected a field" : "unknown field '" + name + "'";
+    return nullptr;
+  }
+  Instruction predicate = {kCompare, Field(field), kEq, false, 0};
+  bool is_string = field == kKey || field == kCategory;
+  PatternSet::Mode mode = PatternSet::kExact;
+  bool found = false;
+  for (size_t i = 0; !found && i < sizeof(kCompareOps) / sizeof(kCompareOps[0]); i++) {
+    static const Compare kCompares[] = {kLe, kGe, kNe, kEq, kLt, kGt};
+    if ((found = next_is(kCompareOps[i]))) {
+      predicate.compare = kCompares[i];
+    }
+  }
+  for (size_t i = 0; is_string && !found && i < sizeof(kMatchOps) / sizeof(kMatchOps[0]); i++) {
+    static const PatternSet::Mode kModes[] = {PatternSet::kPrefix, PatternSet::kSuffix, PatternSet::kSubstring};
+    if ((found = next_is(kMatchOps[i]))) {
+      mode = kModes[i];
+    }
+  }
+  if (!found || (is_string && predicate.compare != kEq && predicate.compare != kNe)) {
+    error_ = "unsupported operator for '" + name + "'";
+    return nullptr;
+  }
+
+  // a quoted value is taken as it is, an unquoted one ends at a space or ')'
+  skip_space();
+  size_t value_start = pos_;
+  string value;
+  bool quoted = pos_ < expr_.size() && (expr_[pos_] == '\'' || expr_[pos_] == '"');
+  if (quoted) {
+    size_t end = expr_.find(expr_[pos_], pos_ + 1);
+    if (end == string::npos) {
+      error_ = "unterminated quote";
+      return nullptr;
+    }
+    value = expr_.substr(pos_ + 1, end - pos_ - 1);
+    pos_ = end + 1;
+  } else {
+    start = pos_;
+    while (pos_ < expr_.size() && !isspace((unsigned char)expr_[pos_]) && expr_[pos_] != ')') {
+      pos_++;
+    }
+    value = expr_.substr(start, pos_ - start);
+  }
+
+  if (is_string) {
+    vector<string> patterns;
+    for (size_t begin = 0, end; !quoted && begin <= value.size(); begin = end + 1) {
+      end = min(value.find('|', begin), value.size());
+      patterns.push_back(value.substr(begin, end - begin));
+    }
+    if (quoted) {
+      patterns.push_back(value);
+    }
+    // an empty prefix, suffix or substring matches every item, it is most likely a typo
+    for (const auto &pattern : patterns) {
+      if (pattern.empty() && mode != PatternSet::kExact) {
+        pos_ = value_start;
+        error_ = "empty pattern for '" + name + "'";
+        return nullptr;
+      }
+    }
+    predicate.op = kMatch;
+    predicate.negate = predicate.compare == kNe;
+    predicate.value = pattern_sets_.size();
+    pattern_sets_.emplace_back(mode, patterns);
+  } else {
+    char *end = nullptr;
+    errno = 0;
+    predicate.value = strtoll(value.c_str(), &end, 10);
+    if (value.empty() || *end || errno) {
+      error_ = "'" + value + "' is not a number";
+      return nullptr;
+    }
+  }
+  return unique_ptr<Node>(new Node{Node::kPredicate, predicate, nullptr, nullptr});
+}
+
+
+bool ItemFilter::reads_key(const Node *node) {
+  if (node->type == Node::kPredicate) {
+    return node->predicate.field == kKey || node->predicate.field == kCategory;
+  }
+  return reads_key(node->left.get()) || (node->right && reads_key(node->right.get()));
+}
+
+
+void ItemFilter::split_conjuncts(const Node *node, vector<const Node *> *conjuncts) {
+  if (node->type == Node::kAnd) {
+    split_conjuncts(node->left.get(), conjuncts);
+    split_conjuncts(node->right.get(), conjuncts);
+  } else {
+    conjuncts->push_back(node);
+  }
+}
+
+
+void ItemFilter::flatten(const Node *node, vector<Instruction> *program) {
+  switch (node->type) {
+    case Node::kPredicate:
+      program->push_back(node->predicate);
+      break;
+    case Node::kNot:
+      flatten(node->left.get(), program);
+      program->push_back({kNot, kKey, kEq, false, 0});
+      break;
+    case Node::kAnd:
+    case Node::kOr: {
+      // the result of the left side is the result of the whole when it decides it
+      flatten(node->left.get(), program);
+      size_t jump = program->size();
+      program->push_back({node->type == Node::kAnd ? kJumpIfFalse : kJumpIfTrue, kKey, kEq, false, 0});
+      flatten(node->right.get(), program);
+      (*program)[jump].value = program->size();
+      break;
+    }
+  }
+}
+
+
+bool ItemFilter::run(const vector<Instruction> &program, unsigned int cur_time, const ItemView &item) const {
+  bool result = true;
+  for (size_t pc = 0; pc < program.size(); pc++) {
+    const Instruction &ins = program[pc];
+    int64_t value = 0;
+    switch (ins.op) {
+      case kCompare:
+        switch (ins.field) {
+          case kSlab: value = item.slab_id; break;
+          case kKeySize: value = item.key.size; break;
+          case kValSize: value = item.nbytes; break;
+          case kSize: value = item.key.size + item.nbytes; break;
+          case kTtl: value = item.exp_time ? int64_t(item.exp_time) - cur_time : numeric_limits<int64_t>::max(); break;
+          case kIdle: value = int64_t(cur_time) - item.touch_time; break;
+          case kCas: value = item.cas; break;
+          default: break;
+        }
+        switch (ins.compare) {
+          case kEq: result = value == ins.value; break;
+          case kNe: result = value != ins.value; break;
+          case kLt: result = value < ins.value; break;
+          case kLe: result = value <= ins.value; break;
+          case kGt: result = value > ins.value; break;
+          case kGe: result = value >= ins.value; break;
+        }
+        break;
+      case kMatch:
+        result = pattern_sets_[ins.value].match(ins.field == kKey ? item.key : item.category) != ins.negate;
+        break;
+      case kNot:
+        result = !result;
+        break;
+      case kJumpIfFalse:
+      case kJumpIfTrue:
+        if (result == (ins.op == kJumpIfTrue)) {
+          pc = ins.value - 1;
+        }
+        break;
+    }
+  }
+  return result;
+}
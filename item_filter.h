@@ -0,0 +1,110 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "item_view.h"
+#include "pattern_set.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// The items selected by --where, e.g.
+//   key^=user:|sess: and (size>=4096 or ttl<0) and not slab=3
+// Fields are key, category (matched by =, !=, ^= prefix, $= suffix and *= substring against
+// |-separated alternatives, which can only be empty for = and !=) and slab, keysize, valsize, size, ttl, idle, cas (compared as numbers,
+// ttl of items that never expire is infinite and negative for expired ones). The expression is
+// compiled once into a flat program that keeps a single result and short-circuits and/or by jumps.
+// The conjuncts of the top level that only read header fields form a program of their own, so the
+// scan drops most items before it looks at their keys.
+class ItemFilter {
+public:
+  // Returns false after printing the error when the expression is not valid.
+  bool compile(const std::string &expr);
+  // Reads only the numeric fields and the key size of the item, its category is not set yet.
+  bool match_header(unsigned int cur_time, const ItemView &item) const {
+    return header_program_.empty() || run(header_program_, cur_time, item);
+  }
+  bool match_key(unsigned int cur_time, const ItemView &item) const {
+    return key_program_.empty() || run(key_program_, cur_time, item);
+  }
+
+private:
+  enum Field {
+    kKey,
+    kCategory,
+    kSlab,
+    kKeySize,
+    kValSize,
+    kSize,
+    kTtl,
+    kIdle,
+    kCas,
+  };
+  enum Compare {
+    kEq,
+    kNe,
+    kLt,
+    kLe,
+    kGt,
+    kGe,
+  };
+  enum Op {
+    kCompare,
+    // value is the index of the pattern set, negate for !=
+    kMatch,
+    kNot,
+    // value is the index of the instruction to go on with
+    kJumpIfFalse,
+    kJumpIfTrue,
+  };
+  struct Instruction {
+    Op op;
+    Field field;
+    Compare compare;
+    bool negate;
+    int64_t value;
+  };
+  // the parsed expression, before it is flattened
+  struct Node {
+    enum { kPredicate, kAnd, kOr, kNot } type;
+    Instruction predicate;
+    std::unique_ptr<Node> left;
+    std::unique_ptr<Node> right;
+  };
+
+  std::unique_ptr<Node> parse_or();
+  std::unique_ptr<Node> parse_and();
+  std::unique_ptr<Node> parse_not();
+  std::unique_ptr<Node> parse_predicate();
+  bool next_is(const char *token);
+  void skip_space();
+  static bool reads_key(const Node *node);
+  static void flatten(const Node *node, std::vector<Instruction> *program);
+  static void split_conjuncts(const Node *node, std::vector<const Node *> *conjuncts);
+  bool run(const std::vector<Instruction> &program, unsigned int cur_time, const ItemView &item) const;
+
+  // the expression and the parse position, only used by compile()
+  std::string expr_;
+  size_t pos_;
+  std::string error_;
+  std::vector<PatternSet> pattern_sets_;
+  std::vector<Instruction> header_program_;
+  std::vector<Instruction> key_program_;
+};
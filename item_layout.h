@@ -0,0 +1,135 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * This file contains codes from Memcached:
+ *
+ * Copyright (c) 2003, Danga Interactive, Inc.
+ * All rights reserved.
+ *
+ * Full license of Memcached:
+ * https://github.com/memcached/memcached/blob/master/LICENSE
+ *
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+// it_flags of memcached items
+const uint16_t kItemLinked = 1;
+const uint16_t kItemCas = 2;
+const uint16_t kItemSlabbed = 4;
+// since 1.4.29 the data of a large item is in chunks of other slab classes, the item itself
+// only holds the header, the key and the first chunk's header
+const uint16_t kItemChunked = 32;
+// since 1.6 4 bytes of client flags follow the key if they are not 0
+const uint16_t kItemCflags = 256;
+
+// every layout's header is this big, the cas (if enabled) and key follow it
+const size_t kItemHeaderSize = 48;
+
+
+// Copied from memcached.h in memcached-1.4.32 and slightly changed.
+// struct _stritem of 1.4.x and 1.5.x without the data that follows it
+struct ItemHeader14 {
+  const char *next;
+  const char *prev;
+  const char *h_next;    /* hash chain next */
+  unsigned int time;       /* least recent access */
+  unsigned int exptime;    /* expire time */
+  unsigned int nbytes;     /* size of data */
+  unsigned short  refcount;
+  uint8_t         nsuffix;    /* length of flags-and-length string */
+  uint8_t         it_flags;   /* ITEM_* above */
+  uint8_t         slabs_clsid;/* which slab class we're in */
+  uint8_t         nkey;       /* key length, w/terminating null and padding */
+};
+
+// struct _stritem of 1.6.x, nsuffix is gone and it_flags has 16 bits
+struct ItemHeader16 {
+  const char *next;
+  const char *prev;
+  const char *h_next;
+  unsigned int time;
+  unsigned int exptime;
+  unsigned int nbytes;
+  unsigned short  refcount;
+  uint16_t        it_flags;
+  uint8_t         slabs_clsid;
+  uint8_t         nkey;
+};
+// Copy end
+
+static_assert(sizeof(ItemHeader14) == kItemHeaderSize && sizeof(ItemHeader16) == kItemHeaderSize,
+              "the data of an item starts at a multiple of 8 bytes");
+
+
+// What follows the key: 1.4.x and 1.5.x with -o inline_ascii_resp keep " flags length\r\n" as text,
+// 1.5.x without it keeps the flags binary (nsuffix is 4 or 0), 1.6.x flags them by kItemCflags.
+inline size_t item_suffix_size(const ItemHeader14 *it) {
+  return it->nsuffix;
+}
+
+inline size_t item_suffix_size(const ItemHeader16 *it) {
+  return it->it_flags & kItemCflags ? sizeof(uint32_t) : 0;
+}
+
+
+// Compile-time description of an item layout. Everything the scan needs to know of an item is
+// a constant or an inline function of it, so the scan loop is instantiated for every layout.
+template <class Header, bool kInlineAsciiSuffix, bool kCasEnabled>
+struct ItemLayout {
+  typedef Header header_type;
+  // the scan can search the " flags length\r\n" text after keys
+  static const bool kAsciiSuffix = kInlineAsciiSuffix;
+  static const size_t kKeyOffset = kItemHeaderSize + (kCasEnabled ? sizeof(uint64_t) : 0);
+
+  static const Header *header(const char *p) { return reinterpret_cast<const Header *>(p); }
+  static const char *key(const Header *it) { return (const char *)it + kKeyOffset; }
+  // the top 2 bits of slabs_clsid tell the LRU (hot, warm, cold, temp) since 1.4.25
+  static int clsid(const Header *it) { return it->slabs_clsid & ~(3 << 6); }
+  static uint64_t cas(const Header *it) {
+    uint64_t cas = 0;
+    if (kCasEnabled) {
+      memcpy(&cas, (const char *)it + kItemHeaderSize, sizeof(cas));
+    }
+    return cas;
+  }
+  // the data follows the key, its terminating null and the suffix
+  static const char *data(const Header *it) { return key(it) + it->nkey + 1 + item_suffix_size(it); }
+  static bool is_chunked(const Header *it) { return it->it_flags & kItemChunked; }
+};
+
+
+// The header fields of any layout, for the code that does not run per byte of memory.
+struct ItemFields {
+  const char *next;
+  const char *prev;
+  const char *h_next;
+  unsigned int time;
+  unsigned int exptime;
+  unsigned int nbytes;
+  uint16_t it_flags;
+  uint8_t slabs_clsid;
+  uint8_t nkey;
+};
+
+template <class Header>
+ItemFields item_fields(const char *p) {
+  const Header *it = reinterpret_cast<const Header *>(p);
+  return {it->next, it->prev, it->h_next, it->time, it->exptime, it->nbytes, it->it_flags, it->slabs_clsid, it->nkey};
+}
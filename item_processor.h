@@ -16,6 +16,7 @@
 
 #pragma once
 #include "common.h"
+#include "item_view.h"
 
 #include <stdint.h>
 
@@ -33,13 +34,23 @@ public:
   virtual ~ItemProcessor() {}
   void print_options() const;
   virtual bool set_arg(const char *argv) { return false; }
+  // Number of FileDumpers the processor writes through, every scan thread has that many.
+  virtual int file_dumper_cnt() const { return 0; }
+  // Called before init() with the memory left to the processors under --mem-limit-mb once the scan
+  // buffers and the buffers of the FileDumpers of all scan threads are taken.
+  virtual void set_mem_limit(uint64_t mem_left) {}
   virtual bool init() { return true; }
-  virtual void process_item(unsigned int cur_time,
-                              const std::string &key,
-                              const std::string &category,
-                              unsigned int touch_time,
-                              unsigned int exp_time,
-                              unsigned int nbytes,
-                              int slab_id,
-                              uint64_t cas) = 0;
+  // Returns an initialized processor with the same options for another scan thread to use,
+  // or nullptr if the processor can not run in parallel.
+  virtual ItemProcessor *clone(int worker_id) const { return nullptr; }
+  // Folds the results of a processor returned by clone() into this one.
+  virtual void merge(ItemProcessor *other) {}
+  // Called when only a sample of memory is scanned (--sample-rate), after every sampled unit.
+  virtual void end_sample_unit() {}
+  // Called before finish() when sampled_units of total_units were scanned.
+  virtual void set_sample_size(uint64_t sampled_units, uint64_t total_units) {}
+  // Called once on the original processors after the scan is done.
+  virtual void finish() {}
+  // Called on every item found. The views of the item are only valid during the call.
+  virtual void process_item(unsigned int cur_time, const ItemView &item) = 0;
 };
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+
+// A range of bytes, usually in the scan buffer. It does not own them.
+struct ByteView {
+  const char *data;
+  size_t size;
+
+  bool empty() const { return size == 0; }
+  std::string str() const { return std::string(data, size); }
+  bool operator==(const ByteView &other) const {
+    return size == other.size && !memcmp(data, other.data, size);
+  }
+  bool operator==(const std::string &other) const {
+    return size == other.size() && !memcmp(data, other.data(), size);
+  }
+};
+
+
+// An item found in memcached's memory, as it is passed to ItemProcessor::process_item().
+// The views point into the scan buffer and are only valid during that call, a processor copies
+// the bytes it keeps.
+struct ItemView {
+  ByteView key;
+  // the key up to the category delimiter, or __UNKNOWN_CATEGORY__ for keys without one
+  ByteView category;
+  // the data of the item without the trailing "\r\n". data is nullptr when only the header and key
+  // were copied (hash-walk, lru-walk, incremental replay) or the item runs past the end of a block
+  ByteView value;
+  unsigned int touch_time;
+  unsigned int exp_time;
+  // size of the data including the trailing "\r\n"
+  unsigned int nbytes;
+  // bytes the item takes of its slab chunk: header, cas, key, suffix and data
+  unsigned int total_size;
+  int slab_id;
+  uint64_t cas;
+};
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.h"
+#include "key_prober.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <exception>
+
+
+using namespace std;
+
+
+KeyProber::KeyProber():
+  mem_budget_mb_(kDefaultMemBudgetMb),
+  mem_left_(UINT64_MAX),
+  bloom_filter_(false) {
+  processor_summary_ = "Find which keys of a list are in memcached, and dump them with their meta info";
+  processor_name_ = "key prober";
+  args_.emplace_back("--probe-keys-file=$FILE_NAME", "keys to look for, one per line", "(REQUIRED)");
+  args_.emplace_back("--probe-result-file=$FILE_NAME", "file name to write every key as present with its meta info, "
+                     "or as absent", "(REQUIRED)");
+  args_.emplace_back("--probe-mem-mb=$NUM", "Memory budget of the key list, in MB, which counts against --mem-limit-mb",
+                     "64 (MB)");
+  args_.emplace_back("--probe-bloom-filter", "Check a Bloom filter of the keys before the key list, "
+                     "faster when most items of memcached are not in the list", "off");
+}
+
+
+bool KeyProber::set_arg(const char *argv) {
+  const char *val = nullptr;
+  if ((val = is_arg(argv, "--probe-keys-file="))) {
+    keys_filename_ = val;
+  } else if ((val = is_arg(argv, "--probe-result-file="))) {
+    filename_ = val;
+  } else if ((val = is_arg(argv, "--probe-mem-mb="))) {
+    mem_budget_mb_ = atol(val);
+  } else if (!strcmp(argv, "--probe-bloom-filter")) {
+    bloom_filter_ = true;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+void KeyProber::set_mem_limit(uint64_t mem_left) {
+  mem_left_ = mem_left;
+}
+
+
+bool KeyProber::init() {
+  if (keys_filename_.empty() || filename_.empty()) {
+    fprintf(stderr, "probe_keys_file and probe_result_file can not be empty.\n");
+    return false;
+  }
+  if (mem_budget_mb_ < 1) {
+    fprintf(stderr, "--probe-mem-mb must be at least 1\n");
+    return false;
+  }
+  uint64_t mem_budget = mem_budget_mb_ * MB;
+  if (mem_budget > mem_left_) {
+    fprintf(stderr, "--probe-mem-mb=%ld does not fit in the %lu MB left by the scan buffers and the dumpers "
+                    "under --mem-limit-mb\n", mem_budget_mb_, mem_left_ / MB);
+    return false;
+  }
+  auto *keys = new KeySet();
+  keys_.reset(keys);
+  if (!keys->load(keys_filename_, mem_budget, bloom_filter_)) {
+    return false;
+  }
+  fprintf(stderr, "loaded %lu keys to probe in %lu KB\n", keys->size(), keys->mem_size() / KB);
+  found_.assign((keys->size() + 63) / 64, 0);
+  try {
+    file_dumper_.reset(new FileDumper(filename_));
+  } catch (exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return false;
+  }
+  return true;
+}
+
+
+ItemProcessor *KeyProber::clone(int worker_id) const {
+  // each clone writes into its own part file which is appended to the main file on merge
+  auto *prober = new KeyProber();
+  prober->keys_ = keys_;
+  prober->found_.assign(found_.size(), 0);
+  prober->filename_ = filename_ + ".part" + to_string(worker_id);
+  try {
+    prober->file_dumper_.reset(new FileDumper(prober->filename_));
+  } catch (exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    delete prober;
+    return nullptr;
+  }
+  return prober;
+}
+
+
+void KeyProber::merge(ItemProcessor *other) {
+  auto *prober = static_cast<KeyProber *>(other);
+  for (size_t i = 0; i < found_.size(); i++) {
+    found_[i] |= prober->found_[i];
+  }
+  prober->file_dumper_.reset();
+  file_dumper_->append(prober->filename_);
+  unlink(prober->filename_.c_str());
+}
+
+
+void KeyProber::process_item(unsigned int cur_time, const ItemView &item) {
+  int64_t id = keys_->find(item.key);
+  if (id < 0) {
+    return;
+  }
+  found_[id / 64] |= 1lu << (id % 64);
+  char line[384];
+  int len = snprintf(line, sizeof(line),
+                     " present keysize: %zu valsize: %u expire_in_secs: %d last_touch_secs_ago: %d cas: %" PRIu64
+                     " slab: %d", item.key.size, item.nbytes, int(item.exp_time - cur_time),
+                     int(cur_time - item.touch_time), item.cas, item.slab_id);
+  file_dumper_->write_bytes(item.key.data, item.key.size);
+  file_dumper_->write(line, len);
+}
+
+
+void KeyProber::finish() {
+  uint64_t present = 0;
+  for (size_t id = 0; id < keys_->size(); id++) {
+    if (found_[id / 64] & (1lu << (id % 64))) {
+      present++;
+    } else {
+      ByteView key = keys_->key(id);
+      file_dumper_->write_bytes(key.data, key.size);
+      file_dumper_->write(" absent", 7);
+    }
+  }
+  fprintf(stderr, "%lu of %lu probed keys are present\n", present, keys_->size());
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "file_dumper.h"
+#include "item_processor.h"
+#include "key_set.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Tells which keys of a given list are in memcached, without sending it a request. Every item
+// found by the scan is looked up in the list, the ones found are written with their meta info
+// as they are found, and the keys never found are written as absent when the scan is done.
+class KeyProber: public ItemProcessor {
+public:
+  KeyProber();
+  bool set_arg(const char *argv);
+  int file_dumper_cnt() const { return 1; }
+  void set_mem_limit(uint64_t mem_left);
+  bool init();
+  ItemProcessor *clone(int worker_id) const;
+  void merge(ItemProcessor *other);
+  void finish();
+  void process_item(unsigned int cur_time, const ItemView &item);
+
+private:
+  static const int64_t kDefaultMemBudgetMb = 64;
+  // shared by the clones, it is not changed after init()
+  std::shared_ptr<const KeySet> keys_;
+  // a bit for every key of keys_ found by the scan
+  std::vector<uint64_t> found_;
+  std::unique_ptr<FileDumper> file_dumper_;
+  std::string keys_filename_;
+  std::string filename_;
+  int64_t mem_budget_mb_;
+  // what is left to the key list under --mem-limit-mb by the scan buffers and the dumpers
+  uint64_t mem_left_;
+  bool bloom_filter_;
+};
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.h"
+#include "key_set.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace {
+  // memcached keys are at most 250 bytes
+  const size_t kMaxKeySize = 250;
+
+  size_t round_up_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) {
+      p <<= 1;
+    }
+    return p;
+  }
+}
+
+
+bool KeySet::load(const string &filename, uint64_t mem_budget, bool bloom_filter) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    fprintf(stderr, "can not open %s: %s\n", filename.c_str(), strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  uint64_t file_size = st.st_size;
+  if (file_size + kMaxKeySize + 1 > mem_budget || file_size >= UINT32_MAX) {
+    fprintf(stderr, "%s of %lu MB does not fit in the memory budget of %lu MB\n",
+            filename.c_str(), file_size / MB, mem_budget / MB);
+    close(fd);
+    return false;
+  }
+  arena_.resize(file_size + kMaxKeySize + 1);
+  for (uint64_t off = 0; off < file_size; ) {
+    ssize_t n = read(fd, &arena_[off], file_size - off);
+    if (n <= 0) {
+      fprintf(stderr, "read of %s failed: %s\n", filename.c_str(), n ? strerror(errno) : "truncated");
+      close(fd);
+      return false;
+    }
+    off += n;
+  }
+  close(fd);
+  // the last line may miss its '\n'
+  arena_[file_size] = '\n';
+
+  size_t line_cnt = 0;
+  for (const char *p = &arena_[0], *end = p + file_size; p < end; p = (const char *)memchr(p, '\n', end - p + 1) + 1) {
+    line_cnt++;
+  }
+  size_t slot_cnt = round_up_pow2(line_cnt * 10 / 7 + 1);
+  size_t bloom_words = bloom_filter ? round_up_pow2((line_cnt * kBloomBitsPerKey + 511) / 512) * 8 : 0;
+  uint64_t needed = arena_.size() + line_cnt * sizeof(uint32_t) + slot_cnt * sizeof(uint32_t) + bloom_words * 8;
+  if (needed > mem_budget) {
+    fprintf(stderr, "the %lu keys of %s need %lu MB, more than the memory budget of %lu MB\n",
+            line_cnt, filename.c_str(), needed / MB, mem_budget / MB);
+    return false;
+  }
+  offsets_.reserve(line_cnt);
+  slots_.assign(slot_cnt, 0);
+  bloom_.assign(bloom_words, 0);
+  bloom_mask_ = bloom_words ? bloom_words / 8 - 1 : 0;
+
+  size_t skipped = 0;
+  for (uint32_t off = 0; off < file_size; ) {
+    char *line = &arena_[off];
+    char *eol = (char *)memchr(line, '\n', arena_.size() - off);
+    uint32_t next = eol - &arena_[0] + 1;
+    if (eol > line && eol[-1] == '\r') {
+      *--eol = '\n';
+    }
+    ByteView key = {line, size_t(eol - line)};
+    if (key.empty() || key.size > kMaxKeySize) {
+      skipped++;
+    } else {
+      uint64_t h = hash(key);
+      size_t mask = slots_.size() - 1;
+      size_t i = h & mask;
+      for (; slots_[i] && !equals(slots_[i] - 1, key); i = (i + 1) & mask) {
+      }
+      if (!slots_[i]) {
+        slots_[i] = offsets_.size() + 1;
+        offsets_.push_back(off);
+        if (!bloom_.empty()) {
+          bloom_add(h);
+        }
+      }
+    }
+    off = next;
+  }
+  if (skipped) {
+    fprintf(stderr, "%lu lines of %s are empty or longer than %lu bytes, they are not keys\n",
+            skipped, filename.c_str(), kMaxKeySize);
+  }
+  return true;
+}
+
+
+uint64_t KeySet::hash(const ByteView &key) {
+  const uint64_t kMul = 0x9e3779b97f4a7c15lu;
+  uint64_t h = key.size * kMul;
+  size_t i = 0;
+  for (; i + 8 <= key.size; i += 8) {
+    uint64_t word;
+    memcpy(&word, key.data + i, 8);
+    h = (h ^ word) * kMul;
+    h ^= h >> 32;
+  }
+  if (i < key.size) {
+    uint64_t word = 0;
+    memcpy(&word, key.data + i, key.size - i);
+    h = (h ^ word) * kMul;
+    h ^= h >> 32;
+  }
+  // the table takes the low bits, the filter the high ones, both have to be mixed well
+  h ^= h >> 29;
+  h *= 0xbf58476d1ce4e5b9lu;
+  h ^= h >> 32;
+  return h;
+}
+
+
+bool KeySet::equals(uint32_t id, const ByteView &key) const {
+  // the key in the arena ends with '\n' and is followed by enough bytes for any key
+  const char *stored = &arena_[offsets_[id]];
+  return !memcmp(stored, key.data, key.size) && stored[key.size] == '\n';
+}
+
+
+void KeySet::bloom_add(uint64_t h) {
+  uint64_t *block = &bloom_[((h >> 32) & bloom_mask_) * 8];
+  uint64_t bits = h * 0xff51afd7ed558ccdlu;
+  for (int i = 0; i < 8; i++) {
+    block[i] |= 1lu << ((bits >> (i * 8)) & 63);
+  }
+}
+
+
+bool KeySet::bloom_may_contain(uint64_t h) const {
+  const uint64_t *block = &bloom_[((h >> 32) & bloom_mask_) * 8];
+  uint64_t bits = h * 0xff51afd7ed558ccdlu;
+  for (int i = 0; i < 8; i++) {
+    if (!(block[i] & (1lu << ((bits >> (i * 8)) & 63)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+int64_t KeySet::find(const ByteView &key) const {
+  if (offsets_.empty()) {
+    return -1;
+  }
+  uint64_t h = hash(key);
+  if (!bloom_.empty() && !bloom_may_contain(h)) {
+    return -1;
+  }
+  size_t mask = slots_.size() - 1;
+  for (size_t i = h & mask; slots_[i]; i = (i + 1) & mask) {
+    if (equals(slots_[i] - 1, key)) {
+      return slots_[i] - 1;
+    }
+  }
+  return -1;
+}
+
+
+ByteView KeySet::key(size_t id) const {
+  const char *stored = &arena_[offsets_[id]];
+  return {stored, size_t((const char *)memchr(stored, '\n', kMaxKeySize + 1) - stored)};
+}
+
+
+uint64_t KeySet::mem_size() const {
+  return arena_.size() + offsets_.capacity() * sizeof(uint32_t) + slots_.size() * sizeof(uint32_t) + bloom_.size() * 8;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "item_view.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+// A read-only set of keys loaded from a file of one key per line, for millions of keys in little
+// memory: the file is read whole into an arena and its lines are the keys, an open-addressing
+// table of 32-bit key ids finds them. An optional blocked Bloom filter in front of the table
+// answers most lookups of absent keys with one cache line, 8 bits of one 64-byte block per key.
+class KeySet {
+public:
+  KeySet(): bloom_mask_(0) {}
+  // Returns false after printing the reason when the file can not be read or the set would need
+  // more than mem_budget bytes.
+  bool load(const std::string &filename, uint64_t mem_budget, bool bloom_filter);
+  // The id of the key, its line among the distinct keys of the file, or -1 if it is not in the set.
+  int64_t find(const ByteView &key) const;
+  size_t size() const { return offsets_.size(); }
+  ByteView key(size_t id) const;
+  uint64_t mem_size() const;
+
+private:
+  static uint64_t hash(const ByteView &key);
+  bool bloom_may_contain(uint64_t h) const;
+  void bloom_add(uint64_t h);
+  bool equals(uint32_t id, const ByteView &key) const;
+
+  static const int kBloomBitsPerKey = 10;
+  // the file, every key ends with a '\n', and padding so a compare never reads past the end
+  std::vector<char> arena_;
+  std::vector<uint32_t> offsets_;
+  // key id + 1, 0 for an empty slot, size is a power of 2 kept at most 70% full
+  std::vector<uint32_t> slots_;
+  // blocks of 8 words, empty when there is no filter
+  std::vector<uint64_t> bloom_;
+  uint64_t bloom_mask_;
+};
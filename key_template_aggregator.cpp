@@ -0,0 +1,197 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "key_template_aggregator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+using namespace std;
+
+
+namespace {
+  const uint8_t kCharDigit = 1;
+  const uint8_t kCharLowerHex = 2;
+  const uint8_t kCharLowerOther = 4;
+  const uint8_t kCharUpperHex = 8;
+  const uint8_t kCharUpperOther = 16;
+  // the other characters of base64 and base64url
+  const uint8_t kCharBase64 = 32;
+  const uint8_t kCharOther = 64;
+  const uint8_t kCharDelimiter = 128;
+
+  const uint8_t kCharLetter = kCharLowerHex | kCharLowerOther | kCharUpperHex | kCharUpperOther;
+
+  // shorter hex and base64 strings are more likely words
+  const size_t kMinHexSize = 8;
+  const size_t kMinBase64Size = 16;
+  const size_t kUuidSize = 36;
+
+  inline bool only(uint8_t seen, uint8_t allowed) {
+    return (seen & ~allowed) == 0;
+  }
+
+  bool is_uuid(const char *segment, size_t size, uint8_t seen, const uint8_t *char_class) {
+    // 8-4-4-4-12 hex digits
+    if (size != kUuidSize || !only(seen, kCharDigit | kCharLowerHex | kCharUpperHex | kCharBase64)) {
+      return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+      bool dash = i == 8 || i == 13 || i == 18 || i == 23;
+      if (dash ? segment[i] != '-' : !only(char_class[(uint8_t)segment[i]], kCharDigit | kCharLowerHex | kCharUpperHex)) {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+
+KeyTemplateAggregator::KeyTemplateAggregator(SlabInfo *slabs_info, int max_slab_id):
+  ItemAggregator(slabs_info, max_slab_id) {
+  group_name_ = "key template";
+  row_label_ = "TEMPLATE";
+  quantile_row_label_ = "TEMPLATE_QUANTILES";
+  show_slabs_ = false;
+  max_templates_ = kDefaultMaxTemplates;
+  set_delimiters(":|.,;@?&");
+
+  processor_summary_ = "Get a summary of all items per key template, with the ids in keys replaced by placeholders";
+  processor_name_ = "key template aggregator";
+  args_.clear();
+  args_.emplace_back("--template-delimiters=$CHARS", "Characters between the segments of a key", ":|.,;@?&");
+  args_.emplace_back("--template-max=$NUM", "Maximum number of templates kept apart, the items of the others are counted under __OTHER__", "10000");
+  args_.emplace_back("--min-template-rec-num=$NUM", "Minimum number of keys of a template to be shown", "100");
+  args_.emplace_back("--min-template-size-mb=$NUM", "Minimum total size of a template to be shown, in MB", "1 (MB)");
+}
+
+
+void KeyTemplateAggregator::set_delimiters(const char *delimiters) {
+  delimiters_ = delimiters;
+  for (int c = 0; c < 256; c++) {
+    uint8_t cls = kCharOther;
+    if (c >= '0' && c <= '9') {
+      cls = kCharDigit;
+    } else if (c >= 'a' && c <= 'f') {
+      cls = kCharLowerHex;
+    } else if (c >= 'g' && c <= 'z') {
+      cls = kCharLowerOther;
+    } else if (c >= 'A' && c <= 'F') {
+      cls = kCharUpperHex;
+    } else if (c >= 'G' && c <= 'Z') {
+      cls = kCharUpperOther;
+    } else if (c == '+' || c == '/' || c == '=' || c == '-' || c == '_') {
+      cls = kCharBase64;
+    }
+    char_class_[c] = cls;
+  }
+  for (char c : delimiters_) {
+    char_class_[(uint8_t)c] = kCharDelimiter;
+  }
+}
+
+
+bool KeyTemplateAggregator::set_arg(const char *argv) {
+  const char *val = nullptr;
+  if ((val = is_arg(argv, "--template-delimiters="))) {
+    set_delimiters(val);
+  } else if ((val = is_arg(argv, "--template-max="))) {
+    max_templates_ = atol(val);
+  } else if ((val = is_arg(argv, "--min-template-rec-num="))) {
+    min_cat_rec_num_ = atol(val);
+  } else if ((val = is_arg(argv, "--min-template-size-mb="))) {
+    min_cat_size_ = atol(val) * MB;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+bool KeyTemplateAggregator::init() {
+  if (max_templates_ < 1) {
+    fprintf(stderr, "--template-max must be at least 1\n");
+    return false;
+  }
+  max_categories_ = max_templates_;
+  return true;
+}
+
+
+ItemProcessor *KeyTemplateAggregator::clone(int worker_id) const {
+  auto *aggregator = new KeyTemplateAggregator(slabs_info_, max_slab_id_);
+  copy_options(aggregator);
+  aggregator->set_delimiters(delimiters_.c_str());
+  return aggregator;
+}
+
+
+void KeyTemplateAggregator::finish() {
+  printf("\nKey templates: \n");
+  ItemAggregator::finish();
+}
+
+
+void KeyTemplateAggregator::make_template(const ByteView &key, string *out) const {
+  // one pass over the key: the classes of the bytes of a segment are or-ed together,
+  // the segment is classified by that at the delimiter after it
+  out->clear();
+  const char *p = key.data;
+  const char *end = key.data + key.size;
+  while (p <= end) {
+    const char *segment = p;
+    uint8_t seen = 0;
+    uint8_t cls = 0;
+    for (; p < end; p++) {
+      cls = char_class_[(uint8_t)*p];
+      if (cls == kCharDelimiter) {
+        break;
+      }
+      seen |= cls;
+    }
+    size_t size = p - segment;
+    if (size == 0) {
+      // nothing to classify
+    } else if (seen == kCharDigit) {
+      out->push_back('#');
+    } else if (is_uuid(segment, size, seen, char_class_)) {
+      out->append("{uuid}");
+    } else if (size >= kMinHexSize && (seen & kCharDigit)
+               && (only(seen, kCharDigit | kCharLowerHex) || only(seen, kCharDigit | kCharUpperHex))) {
+      out->append("{hex}");
+    } else if (size >= kMinBase64Size && only(seen, kCharDigit | kCharLetter | kCharBase64)
+               && (seen & kCharDigit) && (seen & (kCharLowerHex | kCharLowerOther))
+               && (seen & (kCharUpperHex | kCharUpperOther))) {
+      out->append("{b64}");
+    } else {
+      out->append(segment, size);
+    }
+    if (p < end) {
+      out->push_back(*p);
+    }
+    p++;
+  }
+}
+
+
+void KeyTemplateAggregator::process_item(unsigned int cur_time, const ItemView &item) {
+  make_template(item.key, &template_);
+  ItemView templated = item;
+  templated.category = {template_.data(), template_.size()};
+  ItemAggregator::process_item(cur_time, templated);
+}
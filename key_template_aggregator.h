@@ -0,0 +1,53 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "item_aggregator.h"
+#include "item_view.h"
+
+#include <stdint.h>
+
+#include <string>
+
+
+// The stats of item-aggregator per key template instead of per category: the segments of a key
+// that look like ids are replaced by placeholders, so feed:123456:v2 and feed:987:v2 are both
+// counted under feed:#:v2. Numbers become #, and {uuid}, {hex} and {b64} stand for UUIDs,
+// long hex strings and base64 strings.
+class KeyTemplateAggregator: public ItemAggregator {
+public:
+  KeyTemplateAggregator(SlabInfo *slabs_info, int max_slab_id);
+  bool set_arg(const char *argv);
+  bool init();
+  ItemProcessor *clone(int worker_id) const;
+  void finish();
+  void process_item(unsigned int cur_time, const ItemView &item);
+
+  // Writes the template of key into out.
+  void make_template(const ByteView &key, std::string *out) const;
+
+private:
+  static const long kDefaultMaxTemplates = 10000;
+
+  void set_delimiters(const char *delimiters);
+
+  std::string delimiters_;
+  // kind of every byte value, see the kChar* bits
+  uint8_t char_class_[256];
+  std::string template_;
+  // templates kept apart before the rest are folded into __OTHER__
+  long max_templates_;
+};
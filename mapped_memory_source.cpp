@@ -0,0 +1,171 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mapped_memory_source.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+MappedMemorySource::MappedMemorySource(const string &filename) {
+  filename_ = filename;
+  image_ = nullptr;
+  image_size_ = 0;
+}
+
+
+MappedMemorySource::~MappedMemorySource() {
+  if (image_) {
+    munmap((void *)image_, image_size_);
+  }
+}
+
+
+bool MappedMemorySource::init() {
+  int fd = open(filename_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Can not open %s: %s\n", filename_.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    fprintf(stderr, "%s is empty\n", filename_.c_str());
+    close(fd);
+    return false;
+  }
+  image_size_ = st.st_size;
+  void *image = mmap(nullptr, image_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    fprintf(stderr, "Can not mmap %s: %s\n", filename_.c_str(), strerror(errno));
+    return false;
+  }
+  image_ = (const char *)image;
+  // scans go through the file once from the beginning to the end
+  madvise(image, image_size_, MADV_SEQUENTIAL);
+
+  if (!load_segments()) {
+    return false;
+  }
+  for (const auto &segment : segments_) {
+    if (segment.file_offset + segment.file_size > image_size_) {
+      fprintf(stderr, "%s is truncated\n", filename_.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+
+vector<Area> MappedMemorySource::get_area_list() {
+  vector<Area> area_list;
+  for (const auto &segment : segments_) {
+    if (segment.is_heap) {
+      area_list.push_back(segment.area);
+    }
+  }
+  sort(area_list.begin(), area_list.end(), [](const Area &l, const Area &r) { return l.lo < r.lo; });
+  return area_list;
+}
+
+
+vector<Area> MappedMemorySource::get_data_area_list() {
+  vector<Area> area_list;
+  for (const auto &segment : segments_) {
+    if (!segment.is_data) {
+      continue;
+    }
+    if (!area_list.empty() && area_list.back().hi == segment.area.lo) {
+      area_list.back().hi = segment.area.hi;
+    } else {
+      area_list.push_back(segment.area);
+    }
+  }
+  return area_list;
+}
+
+
+const MappedMemorySource::Segment *MappedMemorySource::find_segment(const char *lo, uint64_t len) const {
+  // there are at most a few hundreds of segments, and a heap and a data segment may overlap
+  for (const auto &segment : segments_) {
+    if (lo >= segment.area.lo && lo + len <= segment.area.hi) {
+      return &segment;
+    }
+  }
+  return nullptr;
+}
+
+
+ssize_t MappedMemorySource::read(const struct iovec *local, size_t local_cnt,
+                                 const struct iovec *remote, size_t remote_cnt) {
+  ssize_t total_read = 0;
+  size_t li = 0;
+  uint64_t local_off = 0;
+  for (size_t ri = 0; ri < remote_cnt && li < local_cnt; ri++) {
+    const char *lo = (const char *)remote[ri].iov_base;
+    const char *hi = lo + remote[ri].iov_len;
+    while (lo < hi && li < local_cnt) {
+      // a region may go on into the next segment, like the data area of the executable does
+      const Segment *segment = find_segment(lo, 1);
+      if (!segment) {
+        if (total_read) {
+          return total_read;
+        }
+        errno = EFAULT;
+        return -1;
+      }
+      uint64_t area_off = lo - segment->area.lo;
+      uint64_t len = min<uint64_t>({uint64_t(hi - lo), uint64_t(segment->area.hi - lo), local[li].iov_len - local_off});
+      copy_out(*segment, area_off, len, (char *)local[li].iov_base + local_off);
+      lo += len;
+      total_read += len;
+      local_off += len;
+      if (local_off == local[li].iov_len) {
+        li++;
+        local_off = 0;
+      }
+    }
+  }
+  return total_read;
+}
+
+
+void MappedMemorySource::copy_out(const Segment &segment, uint64_t area_off, uint64_t len, char *dest) {
+  // the part of the area that is not in the file is zero
+  uint64_t in_file = area_off < segment.file_size ? min(len, segment.file_size - area_off) : 0;
+  memcpy(dest, image_ + segment.file_offset + area_off, in_file);
+  memset(dest + in_file, 0, len - in_file);
+}
+
+
+const char *MappedMemorySource::direct(const struct iovec &remote) {
+  const char *lo = (const char *)remote.iov_base;
+  const Segment *segment = find_segment(lo, remote.iov_len);
+  if (!segment || uint64_t(lo - segment->area.lo) + remote.iov_len > segment->file_size) {
+    return nullptr;
+  }
+  return image_ + segment->file_offset + (lo - segment->area.lo);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include "memory_source.h"
+
+
+// Base of the sources that read a copy of the memory of memcached from a file. The file is
+// mmapped, so a scan runs at page cache speed and blocks inside one segment are parsed in place.
+class MappedMemorySource : public MemorySource {
+public:
+  explicit MappedMemorySource(const std::string &filename);
+  ~MappedMemorySource();
+
+  bool init();
+  std::vector<Area> get_area_list();
+  std::vector<Area> get_data_area_list();
+  ssize_t read(const struct iovec *local, size_t local_cnt, const struct iovec *remote, size_t remote_cnt);
+  const char *direct(const struct iovec &remote);
+  uint64_t mapped_size() const { return image_size_; }
+
+protected:
+  struct Segment {
+    Area area;
+    uint64_t file_offset;
+    // bytes of the area that are in the file, the rest of it reads as zero
+    uint64_t file_size;
+    // whether it is in get_area_list() and in get_data_area_list()
+    bool is_heap;
+    bool is_data;
+  };
+
+  // Fills segments_ from the mapped file, returns false if the file is not in the expected format.
+  virtual bool load_segments() = 0;
+  // Copies len bytes at area_off of a segment, by default from file_offset of the file.
+  virtual void copy_out(const Segment &segment, uint64_t area_off, uint64_t len, char *dest);
+
+  std::string filename_;
+  const char *image_;
+  uint64_t image_size_;
+  std::vector<Segment> segments_;
+
+private:
+  const Segment *find_segment(const char *lo, uint64_t len) const;
+};
@@ -39,28 +39,6 @@ using namespace std;
 volatile bool stop_read_thread = false;
 
 
-int socket_connect(int port) {
-  struct sockaddr_in remote;
-  remote.sin_family = AF_INET;
-  remote.sin_port = htons(port);
-  memset(&remote.sin_zero, 0, 8);
-
-  remote.sin_addr.s_addr = inet_addr("127.0.0.1");
-  int sock_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-  if (sock_fd == -1) {
-    fprintf(stderr, "socket() failed. Message: %s.\n", strerror(errno));
-    return -1;
-  }
-
-  if (connect(sock_fd, (struct sockaddr*)&remote, sizeof(struct sockaddr_in)) == -1) {
-    fprintf(stderr, "connect() to %d failed. Message: %s.\n", port, strerror(errno));
-    close(sock_fd);
-    return -1;
-  }
-  return sock_fd;
-}
-
-
 void recv_proc(int fd) {
   // the procedure runs in separate thread and just consumes whatever mc sends
   static const uint32_t kBufSize = 32 * KB;
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Prints a columnar dump of mcinspector --dump-format=columnar in the text format of the item
+// dumper, one line per item:
+// $KEY keysize: %d valsize: %d expire_in_secs: %d last_touch_secs_ago: %d cas: %lu
+#include "columnar_reader.h"
+#include "common.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+using namespace std;
+
+
+void show_usage(const char *exec) {
+  static const Args args = {
+    make_tuple("--dump-file=$PATH", "Columnar dump to read, multiple of this arguments is allowed", "(REQUIRED)"),
+    make_tuple("--category=$CATEGORY_NAME", "Only print items of the category, multiple of this arguments is allowed", "(ALL IF NOT SPECIFIED)"),
+    make_tuple("--count-only", "Print the number of items and their bytes per category instead of the items", "false"),
+  };
+
+  fprintf(stderr, "Print a columnar dump of the item dumper in its text format.\n");
+  fprintf(stderr, "Usage: %s args\n", exec);
+  fprintf(stderr, "Possible args:\n");
+  for (auto& arg : args) {
+    fprintf(stderr, "  %-30s default: %-20s %s\n", get<0>(arg), get<2>(arg), get<1>(arg));
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  if (argc <= 1) {
+    show_usage(argv[0]);
+    return 1;
+  }
+
+  vector<string> filenames;
+  unordered_set<string> selected;
+  bool count_only = false;
+  for (int x = 1; x < argc; x++) {
+    const char *val = nullptr;
+    if ((val = is_arg(argv[x], "--dump-file="))) {
+      filenames.push_back(val);
+    } else if ((val = is_arg(argv[x], "--category="))) {
+      selected.insert(val);
+    } else if (is_arg(argv[x], "--count-only")) {
+      count_only = true;
+    } else {
+      fprintf(stderr, "error: unknown command-line option: %s\n\n", argv[x]);
+      show_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (filenames.empty()) {
+    fprintf(stderr, "Must specify the columnar dump file\n");
+    return 1;
+  }
+
+  static char out_buf[256 * KB];
+  setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+  // items and bytes per category for --count-only
+  unordered_map<string, pair<uint64_t, uint64_t>> counts;
+  vector<bool> block_selected;
+  for (auto &filename : filenames) {
+    try {
+      ColumnarReader reader(filename);
+      while (reader.next_block()) {
+        block_selected.assign(reader.categories.size(), true);
+        if (!selected.empty()) {
+          for (size_t c = 0; c < reader.categories.size(); c++) {
+            block_selected[c] = selected.count(reader.categories[c].str());
+          }
+        }
+        for (uint32_t i = 0; i < reader.size(); i++) {
+          if (!block_selected[reader.category[i]]) {
+            continue;
+          }
+          if (count_only) {
+            auto &count = counts[reader.categories[reader.category[i]].str()];
+            count.first++;
+            count.second += reader.key_size[i] + reader.val_size[i];
+            continue;
+          }
+          fwrite(reader.keys[i].data, 1, reader.keys[i].size, stdout);
+          printf(" keysize: %d valsize: %u expire_in_secs: %d last_touch_secs_ago: %d cas: %" PRIu64 "\n",
+                 reader.key_size[i], reader.val_size[i], reader.expire_in_secs[i],
+                 reader.last_touch_secs_ago[i], reader.cas[i]);
+        }
+      }
+      if (reader.corrupted()) {
+        fprintf(stderr, "%s is corrupted or truncated\n", filename.c_str());
+        return 1;
+      }
+    } catch (runtime_error &e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+  }
+  for (auto &count : counts) {
+    printf("%s %" PRIu64 " %" PRIu64 "\n", count.first.c_str(), count.second.first, count.second.second);
+  }
+  return 0;
+}
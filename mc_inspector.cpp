@@ -30,8 +30,28 @@
 #include "item_aggregator.h"
 #include "item_processor.h"
 #include "item_dumper.h"
+#include "item_filter.h"
 #include "expired_item_dumper.h"
-
+#include "prefix_trie.h"
+#include "key_template_aggregator.h"
+#include "key_prober.h"
+#include "top_items.h"
+#include "slab_optimizer.h"
+#include "work_stealing_queue.h"
+#include "blocking_queue.h"
+#include "scan_kernel.h"
+#include "memory_source.h"
+#include "process_memory_source.h"
+#include "core_memory_source.h"
+#include "snapshot_memory_source.h"
+#include "snapshot_writer.h"
+#include "incremental_state.h"
+#include "item_layout.h"
+#include "scan_throttle.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <malloc.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
@@ -43,8 +63,13 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <random>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -52,120 +77,83 @@
 using namespace std;
 
 
-// Copied from memcached.h in memcached-1.4.32 and slightly changed
-#define MAX_NUMBER_OF_SLAB_CLASSES 63
-#define ITEM_clsid(item) ((item)->slabs_clsid & ~(3<<6))
-
-typedef struct _stritem {
-  struct _stritem *next;
-  struct _stritem *prev;
-  struct _stritem *h_next;    /* hash chain next */
-  unsigned int time;       /* least recent access */
-  unsigned int exptime;    /* expire time */
-  unsigned int nbytes;     /* size of data */
-  unsigned short  refcount;
-  uint8_t         nsuffix;    /* length of flags-and-length string */
-  uint8_t         it_flags;   /* ITEM_* above */
-  uint8_t         slabs_clsid;/* which slab class we're in */
-  uint8_t         nkey;       /* key length, w/terminating null and padding */
-  /* this odd type prevents type-punning issues when we do
-   * the little shuffle to save space when not using CAS. */
-  union {
-      uint64_t cas;
-      char end;
-  } data[];
-  /* if it_flags & ITEM_CAS we have 8 bytes CAS */
-  /* then null-terminated key */
-  /* then " flags length\r\n" (no terminating null) */
-  /* then data with terminating \r\n (no terminating null; it's binary!) */
-} item;
-// Copy end
-
-
 namespace {
   // global variables
 
   // memcached uses its own clock (secs since server started), so need to maintain relative time
   time_t server_start_unixtime;
+  // time in the stats file, used as the current time when reading a copy of the memory
+  time_t stats_unixtime;
   pid_t pid;
+  // tcp port in the stats settings, for the latency probe of the throttle
+  int mc_port = 11211;
+  MemorySource *memory_source = nullptr;
+  // paces the block scans of the live process, nullptr when they run at full speed
+  ScanThrottle *scan_throttle = nullptr;
+  bool offline_source = false;
 
   bool cas_enabled = true;
-  const int kMaxSlabId = MAX_NUMBER_OF_SLAB_CLASSES + 1;
+  // version of memcached and whether it keeps " flags length\r\n" after keys, they tell the item layout
+  int mc_version_major = 1;
+  int mc_version_minor = 4;
+  bool inline_ascii_response = false;
+  bool has_inline_ascii_response = false;
+  // slab class ids are 1 to 63, MAX_NUMBER_OF_SLAB_CLASSES of memcached
+  const int kMaxSlabId = 63 + 1;
+  // a copy of an item's header and key, see gather_items()
+  const size_t kItemSlotSize = kItemHeaderSize + sizeof(uint64_t) + kMaxKeySpan;
   uint64_t key_cnt_in_mc = 0;
-  uint64_t key_cnt_found = 0;
+  int hash_power = 16;
+  // LARGEST_ID of memcached, number of LRU lists. it is 256 since the segmented LRU of 1.4.25
+  int lru_id_cnt = 256;
+  atomic<uint64_t> key_cnt_found(0);
+  // offset of the key in an item, the header and the cas if it is enabled
+  uint64_t datafield_off = 0;
+  char category_delimiter = ':';
+  // items not selected by --where are not passed to the processors
+  ItemFilter *item_filter = nullptr;
+  const ScanKernel *scan_kernel = nullptr;
+  // words of an item header that are tested before the rest of it, see header_signature()
+  const int kHeaderSignatureCnt = 4;
+  // The parts of the scan that read items, for one item layout. The per-byte work is inlined
+  // into parse_block, the rest goes through the layout-independent ItemFields.
+  struct ItemParser {
+    const char *name;
+    // what the byte search looks for: the " flags length\r\n" suffix or the header of items
+    const char *detector;
+    array<WordSignature, kHeaderSignatureCnt> header_signature;
+    size_t key_offset;
+    void (*parse_block)(const char *pbuf, int read_bytes, const vector<ItemProcessor *> &processors);
+    const char *(*find_next_item)(const char *pbuf, int read_bytes, int *pos, unsigned int cur_time);
+    void (*emit_item)(const char *it, const char *end, unsigned int cur_time, const vector<ItemProcessor *> &processors);
+    ItemFields (*fields)(const char *it);
+  };
+  const ItemParser *item_parser = nullptr;
 
-  vector<string> split_line(const string& line) {
-    stringstream ss(line);
-    vector<string> tokens;
-    string buf;
-    while (ss >> buf) {
-      tokens.push_back(buf);
-    }
-    return tokens;
-  }
+  enum class ScanMode {
+    kHeuristic,
+    kSlabWalk,
+    kHashWalk,
+    kLruWalk,
+  };
+  ScanMode scan_mode = ScanMode::kHeuristic;
+  atomic<uint64_t> slab_walked_bytes(0);
+  atomic<uint64_t> zero_page_bytes(0);
+  // --sample-rate picks one random unit of this size out of every 1 / rate consecutive ones
+  const uint64_t kSampleUnitSize = MB;
+  atomic<uint64_t> sampled_units(0);
 
   SlabInfo slabs_info[kMaxSlabId];
 }
 
 
-int compute_item_datafield_offset() {
-  // 'cas' field in item is defined as uint64_t
-  int cas_field_size = cas_enabled ? sizeof(uint64_t) : 0;
-  return offsetof(item, data) + cas_field_size;
-}
-
-
-struct Area {
-  const char *lo;
-  const char *hi;
-
-  Area(const char * const lo, const char * const hi) : lo(lo), hi(hi) {}
-
-  // construct an area from "7f7f14000000-7f7f17ffa000" liked string
-  Area(const string &s) {
-    uint64_t addr[2] = {0};
-    sscanf(s.c_str(), "%" PRIx64 "-%" PRIx64, &addr[0], &addr[1]);
-    lo = (const char *)(addr[0]);
-    hi = (const char *)(addr[1]);
-  }
-
-  bool operator<(const Area &r) const {
-    // assuming the Area objects have no overlap
-    return lo < r.lo && hi <= r.lo;
-  }
-
-  uint64_t size() const {
-    return hi - lo;
-  }
-};
-
-
-vector<Area> get_area_list(pid_t pid) {
-  // get address spaces of a pid by reading system file in /proc
-  ifstream infile("/proc/" + to_string(pid) + "/maps");
-  string line;
-
-  vector<Area> area_list;
-
-  while (getline(infile, line)) {
-    auto tokens = split_line(line);
-    if (tokens.size() >= 5 && tokens[1] == "rw-p" && tokens[4] == "0") {
-      // not all memory region store data that we want.
-      // we are looking for private heap area
-      // which has r/w permission and is not mapped from file
-      Area mem_area(tokens[0]);
-      if (mem_area.size() < 128 * KB) {
-        continue;
-      }
-      area_list.push_back(mem_area);
-    }
-  }
-  return area_list;
+unsigned int mc_current_time() {
+  // memcached uses secs since server started as its clock
+  return (offline_source ? stats_unixtime : time(nullptr)) - server_start_unixtime;
 }
 
 
-int get_mc_server_info(const char *stats_file) {
-  ifstream infile(stats_file);
+int get_mc_server_info(istream &infile) {
   string line;
   time_t now = 0;
   int uptime = 0;
@@ -201,6 +189,25 @@ int get_mc_server_info(const char *stats_file) {
       } else if (tokens[1] == "curr_items") {
         // STAT curr_items 127132063
         key_cnt_in_mc = atol(tokens[2].c_str());
+      } else if (tokens[1] == "version") {
+        // STAT version 1.4.36
+        int major = 0, minor = 0, patch = 0;
+        sscanf(tokens[2].c_str(), "%d.%d.%d", &major, &minor, &patch);
+        if (make_tuple(major, minor, patch) < make_tuple(1, 4, 25)) {
+          lru_id_cnt = 200;
+        }
+        mc_version_major = major;
+        mc_version_minor = minor;
+      } else if (tokens[1] == "inline_ascii_response") {
+        // STAT inline_ascii_response no
+        has_inline_ascii_response = true;
+        inline_ascii_response = (tokens[2] == "yes");
+      } else if (tokens[1] == "tcp_port") {
+        // STAT tcp_port 11211
+        mc_port = atoi(tokens[2].c_str());
+      } else if (tokens[1] == "hash_power_level") {
+        // STAT hash_power_level 16
+        hash_power = atoi(tokens[2].c_str());
       } else if (tokens[1] == "uptime") {
         // STAT uptime 3880664
         uptime = atoi(tokens[2].c_str());
@@ -216,6 +223,7 @@ int get_mc_server_info(const char *stats_file) {
     }
   }
   if (now && uptime) {
+    stats_unixtime = now;
     server_start_unixtime = now - uptime;
     return 0;
   } else {
@@ -230,6 +238,1194 @@ namespace {
 }
 
 
+vector<struct iovec> next_scan_block(const vector<Area> &area_list,
+                                     const char *current_remote_address,
+                                     uint64_t block_size) {
+  // process_vm_readv accepts reading multiple region in one batch
+  // below is to make up the batch with total size of block_size,
+  // continuing from the place where the previous batch stopped
+  vector<struct iovec> read_region_list;
+  Area needle = {current_remote_address, current_remote_address};
+  auto it = lower_bound(area_list.begin(), area_list.end(), needle);
+  if (it == area_list.end()) {
+    return read_region_list;
+  }
+  current_remote_address = max(it->lo, current_remote_address);
+
+  size_t remote_block_size = min<size_t>(block_size, size_t(it->hi - current_remote_address));
+  struct iovec iov = {(void *)current_remote_address, remote_block_size};
+  read_region_list.emplace_back(iov);
+  int64_t bytes_to_read = remote_block_size;
+  it++;
+  for (; it < area_list.end() && bytes_to_read < (signed)block_size && read_region_list.size() < IOV_MAX; it++) {
+    remote_block_size = min<size_t>(block_size - bytes_to_read, it->size());
+    struct iovec iov = {(void *)it->lo, remote_block_size};
+    read_region_list.emplace_back(iov);
+    bytes_to_read += remote_block_size;
+  }
+  return read_region_list;
+}
+
+
+template <class Layout>
+const typename Layout::header_type *detect_item(const char *pbuf, int i, unsigned int cur_time) {
+  // pbuf[i] is ' ' + a digit, the precondition of there being an item around here.
+  // jump over current ' ' and 'null-termination-char' (actually may not be null) of key
+  // currently it's assuming the byte just before the key starts is not a printable ascii.
+  // NOTICE: this key boundary detection logic may need to be improved in some cases:
+  // it may miss some keys if the cas is disabled when mc server was started,
+  // or the mc server has been running very very long time, that global cas in mc server
+  // is several times of 2^56, or the machine is in big-endian.
+  int possible_key_len = scan_kernel->key_span(pbuf, i - 2, Layout::kKeyOffset);
+  int p = i - 1 - possible_key_len;
+  const auto *probed = Layout::header(pbuf + p - Layout::kKeyOffset);
+  if (possible_key_len < 3 || probed->nkey != possible_key_len) {
+    // key length in struct does not equal to the detected length, it's false positive
+    return nullptr;
+  }
+
+  // the data of a chunked item is somewhere else, only its header and key are in its own chunk
+  uint64_t size_in_chunk = Layout::is_chunked(probed) ? 0 : probed->nbytes;
+  if (probed->time > 365 * 86400 * 10 || probed->time >= cur_time + 50
+      || (probed->it_flags & kItemLinked) == 0
+      || size_in_chunk + probed->nkey > slabs_info[Layout::clsid(probed)].unit_size) {
+    // since the item came from raw memory scan, there might be some corrupted entries.
+    // so some sanity checks are applied to filter out them
+    return nullptr;
+  }
+  return probed;
+}
+
+
+template <class Layout>
+const typename Layout::header_type *find_next_marked_item(const char *pbuf, int read_bytes, int *pos, unsigned int cur_time) {
+  // search from *pos for the " flags length\r\n" suffix of an item
+  for (int i = *pos; i < read_bytes - 1; i += 64) {
+    int page = i - i % kZeroCheckSize;
+    if (i - page < 64 && page + kZeroCheckSize <= read_bytes && scan_kernel->is_zero(pbuf + page)) {
+      // memory that was never used is zero, it has no markers
+      zero_page_bytes += kZeroCheckSize;
+      i = page + kZeroCheckSize - 64;
+      continue;
+    }
+    // positions of ' ' + a digit in the next 64 bytes, the kernel reads one byte more
+    uint64_t markers = i + 64 < read_bytes
+      ? scan_kernel->find_markers(pbuf + i)
+      : find_markers_tail(pbuf + i, read_bytes - 1 - i);
+    while (markers) {
+      int marker = i + __builtin_ctzll(markers);
+      markers &= markers - 1;
+      const auto *probed = detect_item<Layout>(pbuf, marker, cur_time);
+      if (probed) {
+        // the value of the item can not contain another item
+        *pos = marker + 1 + (Layout::is_chunked(probed) ? 0 : probed->nbytes);
+        return probed;
+      }
+    }
+  }
+  return nullptr;
+}
+
+
+// next, prev and h_next of a header are null or 8-byte aligned pointers into the user address space
+const uint64_t kItemPointerMask = 0xffff800000000007lu;
+
+// What the words of a linked item's header match: its pointers, and the word from refcount to nkey
+// that has it_flags linked and not slabbed, some class and a key. The pointer of next comes first,
+// values almost never match it.
+template <class Header>
+array<WordSignature, kHeaderSignatureCnt> header_signature() {
+  Header mask = {}, value = {}, nonzero = {};
+  mask.it_flags = kItemLinked | kItemSlabbed;
+  value.it_flags = kItemLinked;
+  nonzero.slabs_clsid = 0xff;
+  nonzero.nkey = 0xff;
+  const int flags_offset = offsetof(Header, refcount);
+  WordSignature flags = {flags_offset, 0, 0, 0};
+  memcpy(&flags.mask, (const char *)&mask + flags_offset, sizeof(uint64_t));
+  memcpy(&flags.value, (const char *)&value + flags_offset, sizeof(uint64_t));
+  memcpy(&flags.nonzero_bytes, (const char *)&nonzero + flags_offset, sizeof(uint64_t));
+  return {{
+    {offsetof(Header, next), kItemPointerMask, 0, 0},
+    flags,
+    {offsetof(Header, prev), kItemPointerMask, 0, 0},
+    {offsetof(Header, h_next), kItemPointerMask, 0, 0},
+  }};
+}
+
+// memcached's clock counts from its start, items are neither touched nor expire this far from it
+const unsigned int kTenYears = 365 * 86400 * 10;
+
+
+template <class Layout>
+const typename Layout::header_type *detect_header(const char *pbuf, int p, int read_bytes, unsigned int cur_time) {
+  // pbuf + p matched header_signature(), what is left are the checks that need the stats, the clock or the key
+  const auto *probed = Layout::header(pbuf + p);
+  int64_t unit_size = slabs_info[Layout::clsid(probed)].unit_size;
+  const char *key = Layout::key(probed);
+  const char *data = Layout::data(probed);
+  const char *end = pbuf + read_bytes;
+  if (unit_size == 0 || data > end
+      || probed->time > kTenYears || probed->time >= cur_time + 50
+      || (probed->exptime && probed->exptime >= cur_time + kTenYears)
+      || (Layout::kAsciiSuffix && (data == key + probed->nkey + 1 || key[probed->nkey + 1] != ' '))) {
+    return nullptr;
+  }
+  // the header, cas, key and suffix are in the chunk of the item, so is the data unless it is chunked
+  int64_t size_in_chunk = data - (const char *)probed + (Layout::is_chunked(probed) ? 0 : probed->nbytes);
+  if (size_in_chunk > unit_size
+      || scan_kernel->key_span(key, probed->nkey - 1, -1) != probed->nkey) {
+    return nullptr;
+  }
+  bool data_checkable = !Layout::is_chunked(probed) && data + probed->nbytes <= end;
+  if (data_checkable && (probed->nbytes < 2 || memcmp(data + probed->nbytes - 2, "\r\n", 2))) {
+    // the data of every item ends with "\r\n"
+    return nullptr;
+  }
+  if (key[probed->nkey] != '\0') {
+    // memcached does not write the byte after the key, it is only usually zero. without it the
+    // item is only taken when its data could be checked and it would not fit the class below,
+    // as memcached puts every item in the smallest class it fits
+    int clsid = Layout::clsid(probed);
+    if (!data_checkable || (clsid > 1 && size_in_chunk <= (int64_t)slabs_info[clsid - 1].unit_size)) {
+      return nullptr;
+    }
+  }
+  return probed;
+}
+
+
+template <class Layout>
+const typename Layout::header_type *find_next_header(const char *pbuf, int read_bytes, int *pos, unsigned int cur_time) {
+  // search from *pos for an item header. items are in chunks of 8-byte aligned sizes at 8-byte
+  // aligned addresses, and pbuf holds memory from an aligned address, so only every 8th byte is tested.
+  const WordSignature *signature = &item_parser->header_signature[0];
+  for (int i = (*pos + 7) & ~7; i + (int)kItemHeaderSize <= read_bytes; i += 64) {
+    int page = i - i % kZeroCheckSize;
+    if (i - page < 64 && page + kZeroCheckSize <= read_bytes && scan_kernel->is_zero(pbuf + page)) {
+      // memory that was never used is zero, it has no headers
+      zero_page_bytes += kZeroCheckSize;
+      i = page + kZeroCheckSize - 64;
+      continue;
+    }
+    // headers at the next 8 words, the signature words are all in the header
+    uint32_t candidates = i + 64 + (int)kItemHeaderSize <= read_bytes
+      ? scan_kernel->match_words(pbuf + i, signature, kHeaderSignatureCnt)
+      : match_words_tail(pbuf + i, (read_bytes - kItemHeaderSize - i) / 8 + 1, signature, kHeaderSignatureCnt);
+    while (candidates) {
+      int header = i + 8 * __builtin_ctz(candidates);
+      candidates &= candidates - 1;
+      const auto *probed = detect_header<Layout>(pbuf, header, read_bytes, cur_time);
+      if (probed) {
+        const char *item_end = Layout::data(probed) + (Layout::is_chunked(probed) ? 0 : probed->nbytes);
+        *pos = item_end - pbuf;
+        return probed;
+      }
+    }
+  }
+  return nullptr;
+}
+
+
+template <class Layout, bool kByHeader>
+const typename Layout::header_type *find_next_item(const char *pbuf, int read_bytes, int *pos, unsigned int cur_time) {
+  // search from *pos for the next item, *pos is set to where the search goes on after it
+  return kByHeader
+    ? find_next_header<Layout>(pbuf, read_bytes, pos, cur_time)
+    : find_next_marked_item<Layout>(pbuf, read_bytes, pos, cur_time);
+}
+
+
+template <class Layout>
+void emit_item(const typename Layout::header_type *it,
+               const char *end,
+               unsigned int cur_time,
+               const vector<ItemProcessor *> &processors) {
+  // the views point into the buffer the item was found in, nothing is copied.
+  // end is the end of that buffer, or nullptr when it only holds the header and key of the item
+  static const char kUnknownCategory[] = "__UNKNOWN_CATEGORY__";
+  ItemView view;
+  view.key = {Layout::key(it), it->nkey};
+  view.touch_time = it->time;
+  view.exp_time = it->exptime;
+  view.nbytes = it->nbytes;
+  view.total_size = Layout::data(it) - (const char *)it + it->nbytes;
+  view.slab_id = Layout::clsid(it);
+  view.cas = Layout::cas(it);
+  key_cnt_found++;
+  // the header fields are filtered before the key bytes are read
+  if (item_filter && !item_filter->match_header(cur_time, view)) {
+    return;
+  }
+
+  const char *delimiter = (const char *)memchr(view.key.data, category_delimiter, view.key.size);
+  if (delimiter) {
+    view.category = {view.key.data, size_t(delimiter - view.key.data)};
+  } else {
+    view.category = {kUnknownCategory, sizeof(kUnknownCategory) - 1};
+  }
+  if (item_filter && !item_filter->match_key(cur_time, view)) {
+    return;
+  }
+  const char *value = Layout::data(it);
+  if (end && !Layout::is_chunked(it) && it->nbytes >= 2 && value + it->nbytes <= end) {
+    view.value = {value, it->nbytes - 2u};
+  } else {
+    view.value = {nullptr, 0};
+  }
+
+  for (auto ip : processors) {
+    ip->process_item(cur_time, view);
+  }
+}
+
+
+template <class Layout, bool kByHeader>
+void scan_buffer(const char *pbuf, int read_bytes, const vector<ItemProcessor *> &processors) {
+  unsigned int cur_time = mc_current_time();
+  int i = 0;
+  while (const auto *it = find_next_item<Layout, kByHeader>(pbuf, read_bytes, &i, cur_time)) {
+    emit_item<Layout>(it, pbuf + read_bytes, cur_time, processors);
+  }
+}
+
+
+template <class Layout>
+bool is_live_chunk(const typename Layout::header_type *it, int clsid, const char *end, unsigned int cur_time) {
+  const char *key = Layout::key(it);
+  return (it->it_flags & (kItemLinked | kItemSlabbed)) == kItemLinked
+    && Layout::clsid(it) == clsid
+    && it->nkey > 0
+    && key + it->nkey <= end
+    && it->time <= 365 * 86400 * 10 && it->time < cur_time + 50
+    && (Layout::is_chunked(it) ? 0 : it->nbytes) + it->nkey <= slabs_info[clsid].unit_size
+    && scan_kernel->key_span(key, it->nkey - 1, -1) == it->nkey;
+}
+
+
+template <class Layout>
+bool is_free_chunk(const typename Layout::header_type *it) {
+  // do_slabs_free() flags a chunk as slabbed and clears prev while linking it to the free list
+  return (it->it_flags & (kItemLinked | kItemSlabbed)) == kItemSlabbed && it->prev == nullptr;
+}
+
+
+template <class Layout, bool kByHeader>
+void walk_slab_pages(const char *pbuf, int read_bytes, const vector<ItemProcessor *> &processors) {
+  // a slab page is cut into chunks of one class' chunk_size and every chunk starts with an item
+  // header, either of a live item or of a freed one. the byte search is only used to find the
+  // first item of a page, which tells the class, then the page is walked one chunk at a time.
+  unsigned int cur_time = mc_current_time();
+  const char *end = pbuf + read_bytes;
+  int i = 0;
+  while (const auto *first = find_next_item<Layout, kByHeader>(pbuf, read_bytes, &i, cur_time)) {
+    int clsid = Layout::clsid(first);
+    int64_t unit_size = slabs_info[clsid].unit_size;
+    int64_t off = (const char *)first - pbuf;
+    for (; off + (int64_t)Layout::kKeyOffset <= read_bytes; off += unit_size) {
+      const auto *chunk = Layout::header(pbuf + off);
+      if (is_live_chunk<Layout>(chunk, clsid, end, cur_time)) {
+        emit_item<Layout>(chunk, end, cur_time, processors);
+      } else if (!is_free_chunk<Layout>(chunk)) {
+        // end of the page, or it was not a page
+        break;
+      }
+    }
+    slab_walked_bytes += off - ((const char *)first - pbuf);
+    i = max<int64_t>(off, i);
+  }
+}
+
+
+template <class Layout, bool kByHeader>
+void parse_items(const char *pbuf, int read_bytes, const vector<ItemProcessor *> &processors) {
+  if (scan_mode == ScanMode::kSlabWalk) {
+    walk_slab_pages<Layout, kByHeader>(pbuf, read_bytes, processors);
+  } else {
+    scan_buffer<Layout, kByHeader>(pbuf, read_bytes, processors);
+  }
+}
+
+
+template <class Layout, bool kByHeader>
+const ItemParser *make_item_parser(const char *name) {
+  typedef typename Layout::header_type Header;
+  static const ItemParser parser = {
+    name,
+    kByHeader ? "header" : "suffix",
+    header_signature<Header>(),
+    Layout::kKeyOffset,
+    parse_items<Layout, kByHeader>,
+    [](const char *pbuf, int read_bytes, int *pos, unsigned int cur_time) {
+      return (const char *)find_next_item<Layout, kByHeader>(pbuf, read_bytes, pos, cur_time);
+    },
+    [](const char *it, const char *end, unsigned int cur_time, const vector<ItemProcessor *> &processors) {
+      emit_item<Layout>(Layout::header(it), end, cur_time, processors);
+    },
+    item_fields<Header>,
+  };
+  return &parser;
+}
+
+
+template <class Layout>
+const ItemParser *make_item_parser(const char *name, bool by_header) {
+  // only the layouts with the suffix text can be searched by it
+  return by_header || !Layout::kAsciiSuffix
+    ? make_item_parser<Layout, true>(name)
+    : make_item_parser<Layout, false>(name);
+}
+
+
+template <class Header, bool kInlineAsciiSuffix>
+const ItemParser *make_item_parser(const char *name, bool cas_enabled, bool by_header) {
+  return cas_enabled
+    ? make_item_parser<ItemLayout<Header, kInlineAsciiSuffix, true>>(name, by_header)
+    : make_item_parser<ItemLayout<Header, kInlineAsciiSuffix, false>>(name, by_header);
+}
+
+
+const ItemParser *select_item_parser(bool by_header) {
+  // 1.5.0 turned inline_ascii_response off by default, 1.6.0 removed it along with nsuffix
+  if (make_tuple(mc_version_major, mc_version_minor) >= make_tuple(1, 6)) {
+    return make_item_parser<ItemHeader16, false>("1.6", cas_enabled, by_header);
+  }
+  if (make_tuple(mc_version_major, mc_version_minor) >= make_tuple(1, 5)
+      && !(has_inline_ascii_response && inline_ascii_response)) {
+    return make_item_parser<ItemHeader14, false>("1.5", cas_enabled, by_header);
+  }
+  return make_item_parser<ItemHeader14, true>("1.4", cas_enabled, by_header);
+}
+
+
+void parse_block(const char *pbuf, int read_bytes, const vector<ItemProcessor *> &processors) {
+  item_parser->parse_block(pbuf, read_bytes, processors);
+}
+
+
+int read_block(const vector<struct iovec> &read_region_list, char *buf, uint64_t block_size, const char **pbuf) {
+  // a block of a mapped copy of the memory that lies in one region is parsed in place,
+  // otherwise it is read into buf. returns the bytes read, *pbuf is set to where they are
+  if (read_region_list.size() == 1 && (*pbuf = memory_source->direct(read_region_list[0]))) {
+    return read_region_list[0].iov_len;
+  }
+  *pbuf = buf;
+  struct iovec local_region = {(void *)buf, block_size};
+  return memory_source->read(&local_region,
+                             1,  // one local region
+                             &read_region_list[0],
+                             read_region_list.size());
+}
+
+
+void bench_scan_kernels(uint64_t block_size) {
+  // time the search of every kernel on the first block: the marker search and key boundary detection,
+  // or the header signature match
+  auto read_region_list = next_scan_block(memory_source->get_resident_area_list(), 0, block_size);
+  if (read_region_list.empty()) {
+    return;
+  }
+  char *buf = new char[block_size];
+  const char *pbuf = nullptr;
+  int read_bytes = read_block(read_region_list, buf, block_size, &pbuf);
+  for (auto kernel : available_scan_kernels()) {
+    Timer timer;
+    uint64_t candidates = 0;
+    if (!strcmp(item_parser->detector, "header")) {
+      for (int i = 0; i + 64 + (int)kItemHeaderSize <= read_bytes; i += 64) {
+        candidates += __builtin_popcount(kernel->match_words(pbuf + i, &item_parser->header_signature[0],
+                                                             kHeaderSignatureCnt));
+      }
+    } else {
+      for (int i = 0; i + 64 < read_bytes; i += 64) {
+        for (uint64_t markers = kernel->find_markers(pbuf + i); markers; markers &= markers - 1) {
+          int pos = i + __builtin_ctzll(markers);
+          candidates += kernel->key_span(pbuf, pos - 2, datafield_off) >= 3;
+        }
+      }
+    }
+    timer.stop();
+    fprintf(stderr, "scan kernel %-6s: %.2f GB/s on %lu KBytes, %lu %s candidates\n",
+            kernel->name, read_bytes * 1.0 / GB / max<uint64_t>(1, timer.get_us()) * 1000000,
+            read_bytes / KB, candidates, item_parser->detector);
+  }
+  delete [] buf;
+}
+
+
+vector<vector<struct iovec>> plan_scan_blocks(const vector<Area> &area_list, uint64_t block_size) {
+  // blocks are cut the same way as the sequential scan does, so exactly the same items are found
+  vector<vector<struct iovec>> blocks;
+  const char *current_remote_address = 0;
+  for (;;) {
+    auto read_region_list = next_scan_block(area_list, current_remote_address, block_size);
+    if (read_region_list.empty()) {
+      break;
+    }
+    const auto &last = read_region_list.back();
+    current_remote_address = (const char *)last.iov_base + last.iov_len;
+    blocks.emplace_back(move(read_region_list));
+  }
+  return blocks;
+}
+
+
+vector<vector<struct iovec>> plan_sample_blocks(const vector<Area> &area_list,
+                                                uint64_t block_size,
+                                                double sample_rate,
+                                                unsigned int seed,
+                                                uint64_t *total_units) {
+  // areas are cut into units of kSampleUnitSize, and one random unit is picked out of every
+  // stratum of 1 / sample_rate consecutive units, so the sample is spread over the whole heap.
+  // every picked unit is one region of a block, and parsed on its own
+  vector<struct iovec> units;
+  for (const auto &area : area_list) {
+    for (const char *lo = area.lo; lo < area.hi; lo += kSampleUnitSize) {
+      units.push_back({(void *)lo, min<size_t>(kSampleUnitSize, area.hi - lo)});
+    }
+  }
+  *total_units = units.size();
+
+  size_t stratum_size = max<size_t>(1, llround(1 / sample_rate));
+  mt19937 rng(seed);
+  vector<vector<struct iovec>> blocks(1);
+  uint64_t bytes_in_block = 0;
+  for (size_t i = 0; i < units.size(); i += stratum_size) {
+    size_t cnt = min(stratum_size, units.size() - i);
+    const auto &unit = units[i + rng() % cnt];
+    if (bytes_in_block + unit.iov_len > block_size || blocks.back().size() == IOV_MAX) {
+      blocks.emplace_back();
+      bytes_in_block = 0;
+    }
+    blocks.back().push_back(unit);
+    bytes_in_block += unit.iov_len;
+  }
+  if (blocks.back().empty()) {
+    blocks.pop_back();
+  }
+  return blocks;
+}
+
+
+int parallel_scan(int thread_cnt,
+                  uint64_t block_size,
+                  uint64_t keys_limit,
+                  const vector<vector<struct iovec>> &blocks,
+                  bool sample_units,
+                  const vector<ItemProcessor *> &processors,
+                  uint64_t *memscan_time_us,
+                  uint64_t *calculation_time_us,
+                  uint64_t *total_read) {
+  // with sample_units every region of a block is a sample unit, see plan_sample_blocks()
+  uint64_t total_mem_size = 0;
+  for (const auto &block : blocks) {
+    for (const auto &region : block) {
+      total_mem_size += region.iov_len;
+    }
+  }
+
+  // every worker starts with a contiguous range of blocks, heap regions differ a lot in size
+  // so the ones done early steal blocks from the others
+  WorkStealingQueue queue(thread_cnt);
+  for (size_t i = 0; i < blocks.size(); i++) {
+    queue.push(i * thread_cnt / blocks.size(), i);
+  }
+
+  // worker 0 uses the original processors, others use their own clones
+  vector<vector<ItemProcessor *>> worker_processors(thread_cnt);
+  worker_processors[0] = processors;
+  for (int w = 1; w < thread_cnt; w++) {
+    for (auto ip : processors) {
+      auto clone = ip->clone(w);
+      if (!clone) {
+        fprintf(stderr, "Item processor [%s] can not run in parallel.\n", item_processors[ip].c_str());
+        return -1;
+      }
+      worker_processors[w].push_back(clone);
+    }
+  }
+
+  vector<char *> buffers;
+  for (int w = 0; w < thread_cnt; w++) {
+    buffers.push_back(new char[block_size]);
+  }
+
+  atomic<uint64_t> atomic_memscan_time_us(0);
+  atomic<uint64_t> atomic_calculation_time_us(0);
+  atomic<uint64_t> atomic_total_read(0);
+  auto worker = [&](int w) {
+    Timer timer;
+    size_t block_id;
+    while (key_cnt_found <= keys_limit && queue.pop(w, &block_id)) {
+      const auto &read_region_list = blocks[block_id];
+      const char *pbuf = nullptr;
+      if (scan_throttle) {
+        uint64_t block_bytes = 0;
+        for (const auto &region : read_region_list) {
+          block_bytes += region.iov_len;
+        }
+        scan_throttle->before_read(block_bytes);
+      }
+      timer.reset();
+      int read_bytes = read_block(read_region_list, buffers[w], block_size, &pbuf);
+      atomic_memscan_time_us += timer.get_us();
+      if (scan_throttle) {
+        scan_throttle->after_read();
+      }
+      if (read_bytes <= 0) {
+        continue;
+      }
+      uint64_t read_so_far = atomic_total_read += read_bytes;
+      fprintf(stderr, "read %lu KBytes (%.1f%%)\n", read_bytes / KB, read_so_far * 100.0 / total_mem_size);
+
+      timer.reset();
+      if (!sample_units) {
+        parse_block(pbuf, read_bytes, worker_processors[w]);
+      } else {
+        // units are not contiguous in the remote memory, items across two of them are not seen
+        uint64_t off = 0;
+        for (size_t i = 0; i < read_region_list.size() && off < (uint64_t)read_bytes; i++) {
+          uint64_t len = min<uint64_t>(read_region_list[i].iov_len, read_bytes - off);
+          parse_block(pbuf + off, len, worker_processors[w]);
+          for (auto ip : worker_processors[w]) {
+            ip->end_sample_unit();
+          }
+          sampled_units++;
+          off += len;
+        }
+      }
+      atomic_calculation_time_us += timer.get_us();
+    }
+  };
+
+  vector<thread> workers;
+  for (int w = 0; w < thread_cnt; w++) {
+    workers.emplace_back(worker, w);
+  }
+  for (auto &t : workers) {
+    t.join();
+  }
+
+  for (int w = 1; w < thread_cnt; w++) {
+    for (size_t i = 0; i < processors.size(); i++) {
+      processors[i]->merge(worker_processors[w][i]);
+      delete worker_processors[w][i];
+    }
+  }
+  for (auto buf : buffers) {
+    delete [] buf;
+  }
+
+  *memscan_time_us = atomic_memscan_time_us;
+  *calculation_time_us = atomic_calculation_time_us;
+  *total_read = atomic_total_read;
+  return 0;
+}
+
+
+void pipelined_scan(int buffer_cnt,
+                    uint64_t block_size,
+                    uint64_t keys_limit,
+                    const vector<ItemProcessor *> &processors,
+                    uint64_t *memscan_time_us,
+                    uint64_t *calculation_time_us,
+                    uint64_t *total_read) {
+  // a reader thread copies the next blocks into free buffers while the current one is parsed,
+  // so the time of a scan gets close to max(copy, parse) instead of their sum.
+  // with only one buffer the two stages simply take turns.
+  struct ReadBlock {
+    char *buf;
+    const char *pbuf;
+    int read_bytes;
+  };
+  BlockingQueue<char *> free_buffers(buffer_cnt);
+  BlockingQueue<ReadBlock> read_blocks(buffer_cnt);
+  for (int i = 0; i < buffer_cnt; i++) {
+    free_buffers.push(new char[block_size]);
+  }
+
+  atomic<bool> stop_reading(false);
+  thread reader([&] {
+    Timer timer;
+    const char *current_remote_address = 0;
+    while (!stop_reading) {
+      // in every iteration get updated address spaces (though it's should rarely change for mc),
+      // the live process only reads them again after a region could not be read
+      auto area_list = memory_source->get_resident_area_list();
+      uint64_t total_mem_size = 0;
+      for (const auto &area : area_list) {
+        total_mem_size += area.size();
+      }
+
+      // the throttle shrinks the blocks while memcached is slowed down by the scan
+      uint64_t next_block_size = scan_throttle ? scan_throttle->block_size() : block_size;
+      auto read_region_list = next_scan_block(area_list, current_remote_address, next_block_size);
+      if (read_region_list.empty()) {
+        break;
+      }
+      char *buf = free_buffers.pop();
+      const char *pbuf = nullptr;
+
+      if (scan_throttle) {
+        scan_throttle->before_read(next_block_size);
+      }
+      timer.reset();
+      // key function of memory copy from external process
+      int read_bytes = read_block(read_region_list, buf, block_size, &pbuf);
+      *memscan_time_us += timer.get_us();
+      if (scan_throttle) {
+        scan_throttle->after_read();
+      }
+      if (read_bytes) {
+        *total_read += read_bytes;
+      }
+      fprintf(stderr, "read %lu KBytes (%.1f%%)\n", read_bytes / KB, *total_read * 100.0 / total_mem_size);
+
+      uint32_t bytes_left = read_bytes;
+      for (const auto &i : read_region_list) {
+        if (i.iov_len > bytes_left) {
+          current_remote_address = (char *)((uint64_t)i.iov_base + bytes_left);
+          break;
+        } else {
+          current_remote_address = (char *)((uint64_t)i.iov_base + i.iov_len);
+          bytes_left -= i.iov_len;
+        }
+      }
+      read_blocks.push({buf, pbuf, read_bytes});
+    }
+    read_blocks.push({nullptr, nullptr, 0});
+  });
+
+  Timer timer;
+  for (;;) {
+    auto block = read_blocks.pop();
+    if (!block.buf) {
+      break;
+    }
+    if (!stop_reading) {
+      timer.reset();
+      parse_block(block.pbuf, block.read_bytes, processors);
+      *calculation_time_us += timer.get_us();
+      if (key_cnt_found > keys_limit) {
+        // for test of small samples. keep draining so the reader is not stuck on a free buffer
+        stop_reading = true;
+      }
+    }
+    free_buffers.push(block.buf);
+  }
+  reader.join();
+
+  for (int i = 0; i < buffer_cnt; i++) {
+    delete [] free_buffers.pop();
+  }
+}
+
+
+int incremental_scan(ProcessMemorySource *source,
+                     const string &state_file,
+                     uint64_t block_size,
+                     uint64_t keys_limit,
+                     const vector<ItemProcessor *> &processors,
+                     uint64_t *memscan_time_us,
+                     uint64_t *calculation_time_us,
+                     uint64_t *total_read,
+                     uint64_t *replayed_item_cnt) {
+  // the items found on every page are kept in the state file. pages memcached has not written
+  // since the previous scan are not read again, their items are taken from the previous state.
+  const uint64_t page_size = getpagesize();
+  auto area_list = source->get_area_list();
+  IncrementalStateReader previous;
+  bool has_previous = previous.open(state_file, pid, server_start_unixtime, datafield_off);
+  if (!has_previous) {
+    fprintf(stderr, "%s has no state of this memcached process, all pages are scanned\n", state_file.c_str());
+  }
+
+  // the bits are cleared before the memory is read, so a page written while the scan goes on
+  // is dirty in the next scan too
+  vector<vector<bool>> dirty_pages(area_list.size());
+  uint64_t dirty_page_cnt = 0;
+  uint64_t page_cnt = 0;
+  for (size_t a = 0; a < area_list.size(); a++) {
+    auto &dirty = dirty_pages[a];
+    if (!has_previous) {
+      dirty.assign(area_list[a].size() / page_size, true);
+    } else if (!source->get_soft_dirty(area_list[a], &dirty)) {
+      return -1;
+    }
+    for (size_t p = 0; p < dirty.size(); p++) {
+      // an area that is new or has grown was not scanned before
+      if (!dirty[p] && !previous.covered((uint64_t)area_list[a].lo + p * page_size)) {
+        dirty[p] = true;
+      }
+      dirty_page_cnt += dirty[p];
+    }
+    page_cnt += dirty.size();
+  }
+  // once the bits are cleared the old state no longer tells which pages are clean, it is removed
+  // so that a scan that stops before writing the new one starts over instead of replaying it.
+  // the previous state stays readable through its open file
+  if (unlink(state_file.c_str()) < 0 && errno != ENOENT) {
+    fprintf(stderr, "Can not remove %s: %s\n", state_file.c_str(), strerror(errno));
+    return -1;
+  }
+  if (!source->clear_soft_dirty()) {
+    return -1;
+  }
+  fprintf(stderr, "%lu of %lu pages were written since the previous scan\n", dirty_page_cnt, page_cnt);
+
+  IncrementalStateWriter state;
+  if (!state.open(state_file, pid, server_start_unixtime, datafield_off, area_list)) {
+    return -1;
+  }
+  // items are found through the bytes after their key, and the ones starting in the bytes
+  // before the dirty pages are not taken, so a margin of an item slot is read on both sides
+  vector<char> buf(block_size + 2 * kItemSlotSize);
+  vector<uint64_t> slot((kItemSlotSize + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  Timer timer;
+  for (size_t a = 0; a < area_list.size() && key_cnt_found <= keys_limit; a++) {
+    const auto &area = area_list[a];
+    const auto &dirty = dirty_pages[a];
+    for (size_t p = 0, q = 0; p < dirty.size() && key_cnt_found <= keys_limit; p = q) {
+      uint64_t run_size = scan_throttle && dirty[p] ? scan_throttle->block_size() : block_size;
+      for (q = p; q < dirty.size() && dirty[q] == dirty[p] && (q - p) * page_size < run_size; q++) {
+      }
+      uint64_t lo = (uint64_t)area.lo + p * page_size;
+      uint64_t hi = (uint64_t)area.lo + q * page_size;
+      unsigned int cur_time = mc_current_time();
+      vector<PageItems> pages;
+      if (!dirty[p]) {
+        timer.reset();
+        previous.read_pages(lo, hi, &pages);
+        for (const auto &page : pages) {
+          for (size_t off = 0; off < page.records.size();) {
+            uint16_t len;
+            memcpy(&len, &page.records[off], sizeof(len));
+            memcpy(&slot[0], &page.records[off + sizeof(len)], min<size_t>(len, kItemSlotSize));
+            item_parser->emit_item((const char *)&slot[0], nullptr, cur_time, processors);
+            off += sizeof(len) + len;
+          }
+          *replayed_item_cnt += page.item_cnt;
+        }
+        *calculation_time_us += timer.get_us();
+      } else {
+        uint64_t read_lo = max<uint64_t>((uint64_t)area.lo, lo - kItemSlotSize);
+        uint64_t read_hi = min<uint64_t>((uint64_t)area.hi, hi + kItemSlotSize);
+        struct iovec local_region = {(void *)&buf[0], read_hi - read_lo};
+        struct iovec remote_region = {(void *)read_lo, read_hi - read_lo};
+        if (scan_throttle) {
+          scan_throttle->before_read(read_hi - read_lo);
+        }
+        timer.reset();
+        ssize_t read_bytes = max<ssize_t>(0, source->read(&local_region, 1, &remote_region, 1));
+        *memscan_time_us += timer.get_us();
+        if (scan_throttle) {
+          scan_throttle->after_read();
+        }
+        *total_read += read_bytes;
+
+        timer.reset();
+        int i = 0;
+        while (const char *it = item_parser->find_next_item(&buf[0], read_bytes, &i, cur_time)) {
+          auto fields = item_parser->fields(it);
+          uint64_t addr = read_lo + (it - &buf[0]);
+          if (addr >= lo && addr < hi) {
+            item_parser->emit_item(it, &buf[0] + read_bytes, cur_time, processors);
+            uint64_t page = addr / page_size * page_size;
+            if (pages.empty() || pages.back().page != page) {
+              pages.push_back({page, 0, ""});
+            }
+            uint16_t len = datafield_off + fields.nkey;
+            pages.back().item_cnt++;
+            pages.back().records.append((const char *)&len, sizeof(len));
+            pages.back().records.append(it, len);
+          }
+        }
+        *calculation_time_us += timer.get_us();
+      }
+      for (const auto &page : pages) {
+        if (!state.add_page(page)) {
+          fprintf(stderr, "Failed to write %s\n", state_file.c_str());
+          return -1;
+        }
+      }
+    }
+  }
+  if (key_cnt_found > keys_limit) {
+    // a partial state would make the pages not scanned look empty
+    fprintf(stderr, "Keys limit reached, %s is not written\n", state_file.c_str());
+    return 0;
+  }
+  return state.close() ? 0 : -1;
+}
+
+
+uint64_t gather_remote(vector<struct iovec> &local, vector<struct iovec> &remote) {
+  // reads many small remote regions into local ones of the same sizes, IOV_MAX of them per call.
+  // process_vm_readv stops at the first region it fails to read, that region is left zeroed
+  // (e.g. it was freed in the meantime) and the reading goes on from the next one.
+  uint64_t total_read = 0;
+  size_t i = 0;
+  while (i < remote.size()) {
+    size_t cnt = min<size_t>(IOV_MAX, remote.size() - i);
+    ssize_t read_bytes = memory_source->read(&local[i], cnt, &remote[i], cnt);
+    read_bytes = max<ssize_t>(0, read_bytes);
+    total_read += read_bytes;
+    size_t end = i + cnt;
+    for (; i < end && (size_t)read_bytes >= remote[i].iov_len; i++) {
+      read_bytes -= remote[i].iov_len;
+    }
+    if (i < end) {
+      memset(local[i].iov_base, 0, local[i].iov_len);
+      i++;
+    }
+  }
+  return total_read;
+}
+
+
+bool is_linked_item(const ItemFields &it) {
+  int clsid = it.slabs_clsid & ~(3 << 6);
+  return (it.it_flags & (kItemLinked | kItemSlabbed)) == kItemLinked
+    && it.nkey > 0
+    && clsid < kMaxSlabId
+    && slabs_info[clsid].unit_size;
+}
+
+
+uint64_t gather_items(const vector<const char *> &remote_items, vector<char> *slots) {
+  // copies the header and key of remote items into slots of kItemSlotSize bytes,
+  // with one gathered read of all headers, then one of the keys of the linked ones.
+  slots->resize(remote_items.size() * kItemSlotSize);
+  vector<struct iovec> local;
+  vector<struct iovec> remote;
+  for (size_t i = 0; i < remote_items.size(); i++) {
+    local.push_back({&(*slots)[i * kItemSlotSize], datafield_off});
+    remote.push_back({(void *)remote_items[i], datafield_off});
+  }
+  uint64_t read_bytes = gather_remote(local, remote);
+
+  local.clear();
+  remote.clear();
+  for (size_t i = 0; i < remote_items.size(); i++) {
+    auto it = item_parser->fields(&(*slots)[i * kItemSlotSize]);
+    if (is_linked_item(it)) {
+      local.push_back({&(*slots)[i * kItemSlotSize + datafield_off], it.nkey});
+      remote.push_back({(void *)(remote_items[i] + datafield_off), it.nkey});
+    }
+  }
+  return read_bytes + gather_remote(local, remote);
+}
+
+
+bool verify_hash_table(const char *addr, const vector<Area> &area_list) {
+  // the first buckets of a hash table are either empty or point to linked items
+  const int kSampleBuckets = 1024;
+  vector<const char *> buckets(kSampleBuckets);
+  vector<struct iovec> local = {{&buckets[0], kSampleBuckets * sizeof(const char *)}};
+  vector<struct iovec> remote = {{(void *)addr, kSampleBuckets * sizeof(const char *)}};
+  if (gather_remote(local, remote) != kSampleBuckets * sizeof(const char *)) {
+    return false;
+  }
+
+  vector<char> headers;
+  remote.clear();
+  for (auto bucket : buckets) {
+    if (!bucket) {
+      continue;
+    }
+    Area needle = {bucket, bucket};
+    auto it = lower_bound(area_list.begin(), area_list.end(), needle);
+    if (it == area_list.end() || bucket < it->lo) {
+      return false;
+    }
+    remote.push_back({(void *)bucket, kItemHeaderSize});
+  }
+  if (remote.empty()) {
+    return false;
+  }
+  headers.resize(remote.size() * kItemHeaderSize);
+  local.clear();
+  for (size_t i = 0; i < remote.size(); i++) {
+    local.push_back({&headers[i * kItemHeaderSize], kItemHeaderSize});
+  }
+  gather_remote(local, remote);
+  for (size_t i = 0; i < remote.size(); i++) {
+    auto header = item_parser->fields(&headers[i * kItemHeaderSize]);
+    if ((header.it_flags & (kItemLinked | kItemSlabbed)) != kItemLinked || header.nkey == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+const char *find_hash_table(uint64_t bucket_cnt) {
+  // assoc.c keeps the table in 'static item **primary_hashtable', try the symbol table first
+  uint64_t symbol_addr = memory_source->find_symbol("primary_hashtable");
+  if (symbol_addr) {
+    const char *addr = nullptr;
+    vector<struct iovec> local = {{&addr, sizeof(addr)}};
+    vector<struct iovec> remote = {{(void *)symbol_addr, sizeof(addr)}};
+    gather_remote(local, remote);
+    if (addr) {
+      fprintf(stderr, "primary_hashtable found by symbol at %p\n", addr);
+      return addr;
+    }
+  }
+
+  // the table is calloc()ed, and one of this size is always mmap()ed by glibc: the mapping starts
+  // with the chunk header of prev_size and size|IS_MMAPPED, then the table. the mapping may have been
+  // merged with its neighbors, so look for the header at every page of the anonymous areas.
+  const uint64_t kPageSize = getpagesize();
+  const uint64_t kChunkHeaderSize = 2 * sizeof(size_t);
+  const uint64_t table_bytes = bucket_cnt * sizeof(const char *);
+  const size_t chunk_size = ((table_bytes + kChunkHeaderSize + sizeof(size_t) + kPageSize - 1)
+                             & ~(kPageSize - 1)) | 2;
+  // the size fields are read a window of pages at a time into the same buffers, gather_remote()
+  // reads as many as there are remote regions
+  const size_t kPagesPerRead = 4096;
+  vector<size_t> size_fields(kPagesPerRead);
+  vector<struct iovec> local(kPagesPerRead);
+  vector<struct iovec> remote(kPagesPerRead);
+  for (size_t i = 0; i < kPagesPerRead; i++) {
+    local[i] = {&size_fields[i], sizeof(size_t)};
+  }
+  auto area_list = memory_source->get_area_list();
+  for (const auto &area : area_list) {
+    if (area.size() < table_bytes + kChunkHeaderSize) {
+      continue;
+    }
+    const char *page = area.lo;
+    while (page + kChunkHeaderSize + table_bytes <= area.hi) {
+      remote.clear();
+      for (; remote.size() < kPagesPerRead && page + kChunkHeaderSize + table_bytes <= area.hi; page += kPageSize) {
+        remote.push_back({(void *)(page + sizeof(size_t)), sizeof(size_t)});
+      }
+      gather_remote(local, remote);
+      for (size_t i = 0; i < remote.size(); i++) {
+        const char *addr = (const char *)remote[i].iov_base + sizeof(size_t);
+        if (size_fields[i] == chunk_size && verify_hash_table(addr, area_list)) {
+          fprintf(stderr, "primary_hashtable found by searching at %p\n", addr);
+          return addr;
+        }
+      }
+    }
+  }
+  return nullptr;
+}
+
+
+int walk_hash_table(const char *hash_table,
+                    uint64_t keys_limit,
+                    const vector<ItemProcessor *> &processors,
+                    uint64_t *memscan_time_us,
+                    uint64_t *calculation_time_us,
+                    uint64_t *total_read) {
+  // only linked items are in the hash table, so following every bucket's h_next chain gives the
+  // exact set of items. buckets are read a slice at a time, and the items of a slice one chain
+  // hop at a time with gather_items().
+  const uint64_t bucket_cnt = 1lu << hash_power;
+  const uint64_t kBucketsPerSlice = 64 * 1024;
+  const int kMaxChainLength = 1024;  // the chains are being changed under us, don't loop forever
+
+  if (!hash_table) {
+    hash_table = find_hash_table(bucket_cnt);
+    if (!hash_table) {
+      fprintf(stderr, "Can not find primary_hashtable of %lu buckets, specify it by --hashtable-addr\n",
+              bucket_cnt);
+      return -1;
+    }
+  }
+
+  Timer timer;
+  vector<const char *> buckets(kBucketsPerSlice);
+  vector<const char *> chain_items;
+  vector<char> slots;
+  vector<struct iovec> local;
+  vector<struct iovec> remote;
+  for (uint64_t start = 0; start < bucket_cnt && key_cnt_found <= keys_limit; start += kBucketsPerSlice) {
+    uint64_t slice = min(kBucketsPerSlice, bucket_cnt - start);
+    timer.reset();
+    local = {{&buckets[0], slice * sizeof(const char *)}};
+    remote = {{(void *)(hash_table + start * sizeof(const char *)), slice * sizeof(const char *)}};
+    if (gather_remote(local, remote) != slice * sizeof(const char *)) {
+      fprintf(stderr, "Failed to read buckets %lu to %lu of primary_hashtable at %p\n",
+              start, start + slice, hash_table);
+      return -1;
+    }
+    *total_read += slice * sizeof(const char *);
+    *memscan_time_us += timer.get_us();
+
+    chain_items.clear();
+    for (uint64_t i = 0; i < slice; i++) {
+      if (buckets[i]) {
+        chain_items.push_back(buckets[i]);
+      }
+    }
+
+    for (int hop = 0; hop < kMaxChainLength && !chain_items.empty(); hop++) {
+      timer.reset();
+      *total_read += gather_items(chain_items, &slots);
+      *memscan_time_us += timer.get_us();
+
+      timer.reset();
+      unsigned int cur_time = mc_current_time();
+      size_t next_cnt = 0;
+      for (size_t i = 0; i < chain_items.size(); i++) {
+        const char *slot = &slots[i * kItemSlotSize];
+        auto it = item_parser->fields(slot);
+        if (!is_linked_item(it)) {
+          // freed or reused since its bucket was read, the rest of the chain can't be trusted
+          continue;
+        }
+        item_parser->emit_item(slot, nullptr, cur_time, processors);
+        if (it.h_next) {
+          chain_items[next_cnt++] = it.h_next;
+        }
+      }
+      chain_items.resize(next_cnt);
+      *calculation_time_us += timer.get_us();
+    }
+    fprintf(stderr, "walked %lu buckets (%.1f%%)\n", start + slice, (start + slice) * 100.0 / bucket_cnt);
+  }
+  return 0;
+}
+
+
+bool verify_lru_array(const vector<const char *> &lru_ends, bool is_tails) {
+  // every list end points to a linked item of its own LRU id with no neighbor on the outer side
+  vector<const char *> remote_items;
+  vector<int> lru_ids;
+  for (int id = 0; id < lru_id_cnt; id++) {
+    if (lru_ends[id]) {
+      remote_items.push_back(lru_ends[id]);
+      lru_ids.push_back(id);
+    }
+  }
+  if (remote_items.empty()) {
+    return false;
+  }
+  vector<char> slots;
+  gather_items(remote_items, &slots);
+  for (size_t i = 0; i < remote_items.size(); i++) {
+    auto it = item_parser->fields(&slots[i * kItemSlotSize]);
+    if (!is_linked_item(it) || it.slabs_clsid != lru_ids[i] || (is_tails ? it.next : it.prev)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+const char *find_lru_array(bool is_tails) {
+  // items.c keeps the lists in 'static item *heads[LARGEST_ID]' and 'tails[LARGEST_ID]'
+  const char *symbol = is_tails ? "tails" : "heads";
+  uint64_t addr = memory_source->find_symbol(symbol);
+  if (addr) {
+    fprintf(stderr, "LRU %s found by symbol at %p\n", symbol, (const char *)addr);
+    return (const char *)addr;
+  }
+
+  // they are in .bss, look there for an array of pointers that all point to anonymous memory
+  // before asking the remote side whether they are list ends
+  auto heap_area_list = memory_source->get_area_list();
+  auto points_to_heap = [&](const char *p) {
+    Area needle = {p, p};
+    auto it = lower_bound(heap_area_list.begin(), heap_area_list.end(), needle);
+    return it != heap_area_list.end() && p >= it->lo;
+  };
+  for (const auto &area : memory_source->get_data_area_list()) {
+    vector<const char *> data(area.size() / sizeof(const char *));
+    vector<struct iovec> local = {{&data[0], data.size() * sizeof(const char *)}};
+    vector<struct iovec> remote = {{(void *)area.lo, data.size() * sizeof(const char *)}};
+    gather_remote(local, remote);
+    for (size_t i = 0; i + lru_id_cnt <= data.size(); i++) {
+      bool candidate = !data[i];  // LRU id 0 is never used
+      int non_null = 0;
+      for (int id = 1; candidate && id < lru_id_cnt; id++) {
+        candidate = !data[i + id] || (points_to_heap(data[i + id]) && ++non_null);
+      }
+      if (candidate && non_null
+          && verify_lru_array(vector<const char *>(data.begin() + i, data.begin() + i + lru_id_cnt), is_tails)) {
+        addr = (uint64_t)area.lo + i * sizeof(const char *);
+        fprintf(stderr, "LRU %s found by searching at %p\n", symbol, (const char *)addr);
+        return (const char *)addr;
+      }
+    }
+  }
+  return nullptr;
+}
+
+
+int walk_lru_lists(const char *lru_array,
+                   bool from_tail,
+                   uint64_t items_per_list,
+                   const vector<ItemProcessor *> &processors,
+                   uint64_t *memscan_time_us,
+                   uint64_t *calculation_time_us,
+                   uint64_t *total_read) {
+  // follows up to items_per_list items of every LRU list from its tail (least recently used,
+  // what is evicted next) or its head, all lists one hop at a time with gather_items()
+  if (!lru_array) {
+    lru_array = find_lru_array(from_tail);
+    if (!lru_array) {
+      fprintf(stderr, "Can not find LRU %s, specify it by --lru-%s-addr\n",
+              from_tail ? "tails" : "heads", from_tail ? "tails" : "heads");
+      return -1;
+    }
+  }
+
+  Timer timer;
+  vector<const char *> lru_ends(lru_id_cnt);
+  vector<struct iovec> local = {{&lru_ends[0], lru_id_cnt * sizeof(const char *)}};
+  vector<struct iovec> remote = {{(void *)lru_array, lru_id_cnt * sizeof(const char *)}};
+  if (gather_remote(local, remote) != lru_id_cnt * sizeof(const char *)) {
+    fprintf(stderr, "Failed to read LRU lists at %p\n", lru_array);
+    return -1;
+  }
+  *total_read += lru_id_cnt * sizeof(const char *);
+  *memscan_time_us += timer.get_us();
+
+  vector<const char *> cursors;
+  vector<int> lru_ids;
+  for (int id = 0; id < lru_id_cnt; id++) {
+    if (lru_ends[id] && slabs_info[id & ~(3 << 6)].unit_size) {
+      cursors.push_back(lru_ends[id]);
+      lru_ids.push_back(id);
+    }
+  }
+
+  vector<char> slots;
+  for (uint64_t hop = 0; hop < items_per_list && !cursors.empty(); hop++) {
+    timer.reset();
+    *total_read += gather_items(cursors, &slots);
+    *memscan_time_us += timer.get_us();
+
+    timer.reset();
+    unsigned int cur_time = mc_current_time();
+    size_t next_cnt = 0;
+    for (size_t i = 0; i < cursors.size(); i++) {
+      const char *slot = &slots[i * kItemSlotSize];
+      auto it = item_parser->fields(slot);
+      if (!is_linked_item(it) || it.slabs_clsid != lru_ids[i]) {
+        // moved to another list or freed since it was reached, stop following this list
+        continue;
+      }
+      item_parser->emit_item(slot, nullptr, cur_time, processors);
+      const char *next = from_tail ? it.prev : it.next;
+      if (next) {
+        cursors[next_cnt] = next;
+        lru_ids[next_cnt++] = lru_ids[i];
+      }
+    }
+    cursors.resize(next_cnt);
+    lru_ids.resize(next_cnt);
+    *calculation_time_us += timer.get_us();
+  }
+  return 0;
+}
+
+
 void show_usage(const char *exec) {
   static const Args args = {
     make_tuple("--processor=$PROCESSOR_NAME", "Processor to use on each detected item.", "(REQUIRED)"),
@@ -237,10 +1433,44 @@ void show_usage(const char *exec) {
     make_tuple("--keys-limit=$NUM", "Stop the inspector after seen this number of keys", "no upper limit"),
     make_tuple("--mem-limit-mb=$NUM", "Memory use hard limit of this inspector, in MB", "256 (MB)"),
     make_tuple("--category-delimitor=$char", "Specify a prefix delimiter for key string", ":"),
-    make_tuple("--mem-scan-block-size-mb=$NUM", "Memory scan batch size, in MB", "64 (MB)"),
+    make_tuple("--where=$EXPR", "Only pass the items selected by the expression to the processors, e.g. "
+               "'key^=user:|sess: and (size>=4096 or ttl<0)', see item_filter.h", "(ALL ITEMS)"),
+    make_tuple("--mem-scan-block-size-mb=$NUM", "Memory scan batch size, in MB",
+               "64 (MB), less if the scan buffers would not fit"),
+    make_tuple("--threads=$NUM", "Number of threads scanning memory blocks in parallel", "1"),
+    make_tuple("--scan-buffers=$NUM", "Number of buffers the reader fills ahead of a single-threaded scan, with "
+               "more than 1 they have to fit in half of --mem-limit-mb", "2, 1 if 2 do not fit"),
+    make_tuple("--scan-mode=$MODE", "heuristic: search all bytes for items, slab-walk: step over slab pages by chunk size, "
+                                    "hash-walk: follow the hash table to exactly the linked items, "
+                                    "lru-walk: follow the LRU lists for the least or most recently used items", "heuristic"),
+    make_tuple("--item-detector=$NAME", "What heuristic and slab-walk search for, suffix: the \" flags length\\r\\n\" "
+                                        "text after keys, header: the signature of item headers. auto takes suffix "
+                                        "when the items of the memcached version have it", "auto"),
+    make_tuple("--hashtable-addr=$HEX", "Address of the buckets of memcached's primary_hashtable for hash-walk", "(SEARCHED)"),
+    make_tuple("--lru-walk-items=$NUM", "Number of items to report of every LRU list for lru-walk", "1000"),
+    make_tuple("--lru-walk-from=tail|head", "Walk LRU lists from the least (tail) or most (head) recently used", "tail"),
+    make_tuple("--lru-heads-addr=$HEX", "Address of memcached's LRU 'heads' array for lru-walk", "(SEARCHED)"),
+    make_tuple("--lru-tails-addr=$HEX", "Address of memcached's LRU 'tails' array for lru-walk", "(SEARCHED)"),
+    make_tuple("--sample-rate=$RATE", "Scan only this fraction of memory and estimate the stats, between 0 and 1", "1"),
+    make_tuple("--sample-seed=$NUM", "Seed of the random pick of sampled memory units", "(TIME)"),
+    make_tuple("--incremental-state=$PATH", "Keep the items of every page in this file, and rescan only the pages "
+                                            "memcached wrote since the previous run with the same file", "off"),
+    make_tuple("--core-file=$PATH", "Read the memory of memcached from an ELF core file, e.g. made by gcore", "(LIVE PROCESS)"),
+    make_tuple("--snapshot-file=$PATH", "Read the memory of memcached from a file written by --snapshot-out", "(LIVE PROCESS)"),
+    make_tuple("--snapshot-out=$PATH", "Copy the memory of memcached and the stats into a compressed snapshot file, "
+                                       "no processor is run", "off"),
+    make_tuple("--snapshot-raw", "Do not compress the snapshot, so it is scanned in place through mmap", "off"),
+    make_tuple("--max-scan-rate-mb=$NUM", "Copy at most this many MB of memcached's memory per second", "no limit"),
+    make_tuple("--max-cpu-percent=$NUM", "Keep the cpu time of the inspector under this percent of one cpu", "no limit"),
+    make_tuple("--max-latency-us=$NUM", "Probe memcached after every block, and scan in smaller blocks with pauses "
+                                        "while its round trip is more than this slower than the fastest one", "off"),
+    make_tuple("--mc-port=$NUM", "Port of memcached for the latency probe", "tcp_port in stats"),
+    make_tuple("--scan-kernel=$NAME", "Byte search kernel of the scan: avx2, sse2 or scalar", "auto"),
+    make_tuple("--bench-scan-kernels", "Print the parse speed of every kernel on the first block", "off"),
   };
 
-  fprintf(stderr, "The inspector has to run with PTRACE_ATTACH privilege on the memcached process.\n");
+  fprintf(stderr, "The inspector has to run with PTRACE_ATTACH privilege on the memcached process, "
+                  "unless it reads a core or snapshot file.\n");
   fprintf(stderr, "Usage: %s --stats-file=$PATH --processor=$PROC1 [--processor=$PROC2 .. ] [arguments]\n", exec);
   fprintf(stderr, "stats file can be generated by shell command:\n\t'printf \"stats\\nstats slabs\\nstats items\\"
                   "nstats settings\\n\" | netcat 127.0.0.1 11211 > $STATS_FILE'\n");
@@ -261,6 +1491,11 @@ void prepare_item_processors() {
   all_processors.emplace("item-aggregator", new ItemAggregator(slabs_info, kMaxSlabId));
   all_processors.emplace("item-dumper", new ItemDumper());
   all_processors.emplace("expired-dumper", new ExpiredItemDumper());
+  all_processors.emplace("prefix-trie", new PrefixTrie(slabs_info, kMaxSlabId));
+  all_processors.emplace("key-templates", new KeyTemplateAggregator(slabs_info, kMaxSlabId));
+  all_processors.emplace("key-prober", new KeyProber());
+  all_processors.emplace("top-items", new TopItems(slabs_info, kMaxSlabId));
+  all_processors.emplace("slab-optimizer", new SlabOptimizer(slabs_info, kMaxSlabId));
 }
 
 
@@ -281,8 +1516,30 @@ int main(int argc, char *argv[]) {
   uint64_t mem_limit = 256 * MB;
   uint64_t keys_limit = numeric_limits<uint64_t>::max();
   uint64_t mem_scan_block_size = 64 * MB;
-  char category_delimiter = ':';
+  bool block_size_set = false;
+  int thread_cnt = 1;
+  int scan_buffer_cnt = 2;
+  bool scan_buffers_set = false;
+  const char *scan_kernel_name = "auto";
+  const char *item_detector = "auto";
+  const char *hash_table = nullptr;
+  uint64_t lru_walk_items = 1000;
+  bool lru_walk_from_tail = true;
+  const char *lru_heads = nullptr;
+  const char *lru_tails = nullptr;
+  bool bench_kernels = false;
+  double sample_rate = 1;
+  unsigned int sample_seed = time(nullptr);
   const char *stats_file = nullptr;
+  const char *core_file = nullptr;
+  const char *snapshot_file = nullptr;
+  const char *snapshot_out = nullptr;
+  bool snapshot_raw = false;
+  const char *incremental_state = nullptr;
+  uint64_t max_scan_rate = 0;
+  double max_cpu_share = 0;
+  uint64_t max_latency_us = 0;
+  int mc_port_arg = 0;
 
   if (argc <= 1) {
     show_usage(argv[0]);
@@ -304,8 +1561,82 @@ int main(int argc, char *argv[]) {
       mem_limit = atol(val) * MB;
     } else if ((val = is_arg(argv[x], "--category-delimitor="))) {
       category_delimiter = val[0];
+    } else if ((val = is_arg(argv[x], "--where="))) {
+      item_filter = new ItemFilter();
+      if (!item_filter->compile(val)) {
+        return 1;
+      }
     } else if ((val = is_arg(argv[x], "--mem-scan-block-size-mb="))) {
       mem_scan_block_size = atol(val) * MB;
+      block_size_set = true;
+    } else if ((val = is_arg(argv[x], "--threads="))) {
+      thread_cnt = max(1, atoi(val));
+    } else if ((val = is_arg(argv[x], "--scan-buffers="))) {
+      scan_buffer_cnt = max(1, atoi(val));
+      scan_buffers_set = true;
+    } else if ((val = is_arg(argv[x], "--scan-mode="))) {
+      if (!strcmp(val, "heuristic")) {
+        scan_mode = ScanMode::kHeuristic;
+      } else if (!strcmp(val, "slab-walk")) {
+        scan_mode = ScanMode::kSlabWalk;
+      } else if (!strcmp(val, "hash-walk")) {
+        scan_mode = ScanMode::kHashWalk;
+      } else if (!strcmp(val, "lru-walk")) {
+        scan_mode = ScanMode::kLruWalk;
+      } else {
+        fprintf(stderr, "Unknown scan mode '%s'\n", val);
+        return 1;
+      }
+    } else if ((val = is_arg(argv[x], "--item-detector="))) {
+      if (strcmp(val, "auto") && strcmp(val, "suffix") && strcmp(val, "header")) {
+        fprintf(stderr, "Unknown item detector '%s'\n", val);
+        return 1;
+      }
+      item_detector = val;
+    } else if ((val = is_arg(argv[x], "--hashtable-addr="))) {
+      hash_table = (const char *)strtoul(val, nullptr, 16);
+    } else if ((val = is_arg(argv[x], "--lru-walk-items="))) {
+      lru_walk_items = atol(val);
+    } else if ((val = is_arg(argv[x], "--lru-walk-from="))) {
+      if (strcmp(val, "tail") && strcmp(val, "head")) {
+        fprintf(stderr, "--lru-walk-from has to be 'tail' or 'head'\n");
+        return 1;
+      }
+      lru_walk_from_tail = !strcmp(val, "tail");
+    } else if ((val = is_arg(argv[x], "--lru-heads-addr="))) {
+      lru_heads = (const char *)strtoul(val, nullptr, 16);
+    } else if ((val = is_arg(argv[x], "--lru-tails-addr="))) {
+      lru_tails = (const char *)strtoul(val, nullptr, 16);
+    } else if ((val = is_arg(argv[x], "--sample-rate="))) {
+      sample_rate = atof(val);
+      if (sample_rate <= 0 || sample_rate > 1) {
+        fprintf(stderr, "--sample-rate has to be in (0, 1]\n");
+        return 1;
+      }
+    } else if ((val = is_arg(argv[x], "--sample-seed="))) {
+      sample_seed = strtoul(val, nullptr, 10);
+    } else if ((val = is_arg(argv[x], "--incremental-state="))) {
+      incremental_state = val;
+    } else if ((val = is_arg(argv[x], "--core-file="))) {
+      core_file = val;
+    } else if ((val = is_arg(argv[x], "--snapshot-file="))) {
+      snapshot_file = val;
+    } else if ((val = is_arg(argv[x], "--snapshot-out="))) {
+      snapshot_out = val;
+    } else if (!strcmp(argv[x], "--snapshot-raw")) {
+      snapshot_raw = true;
+    } else if ((val = is_arg(argv[x], "--max-scan-rate-mb="))) {
+      max_scan_rate = atol(val) * MB;
+    } else if ((val = is_arg(argv[x], "--max-cpu-percent="))) {
+      max_cpu_share = atof(val) / 100;
+    } else if ((val = is_arg(argv[x], "--max-latency-us="))) {
+      max_latency_us = atol(val);
+    } else if ((val = is_arg(argv[x], "--mc-port="))) {
+      mc_port_arg = atoi(val);
+    } else if ((val = is_arg(argv[x], "--scan-kernel="))) {
+      scan_kernel_name = val;
+    } else if (!strcmp(argv[x], "--bench-scan-kernels")) {
+      bench_kernels = true;
     } else {
       bool captured = false;
       for (auto ip : item_processors) {
@@ -322,174 +1653,249 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (!stats_file) {
-    fprintf(stderr, "Stats file is required.\n");
+  if (!stats_file && !snapshot_file) {
+    fprintf(stderr, "Stats file is required, unless it is taken from a snapshot file.\n");
     fprintf(stderr, "It can be generated by shell command:\n");
     fprintf(stderr, "\tprintf \"stats\\nstats slabs\\nstats items\\nstats settings\\n\""
                     "| netcat 127.0.0.1 11211 > $STATS_FILE.\n");
     return 1;
   }
 
-  if (item_processors.empty()) {
+  if (core_file && snapshot_file) {
+    fprintf(stderr, "Only one of --core-file and --snapshot-file can be used\n");
+    return 1;
+  }
+
+  if (item_processors.empty() && !snapshot_out) {
     fprintf(stderr, "Have to specify at least one item processor\n");
     return 1;
   }
 
+  if (!(scan_kernel = select_scan_kernel(scan_kernel_name))) {
+    fprintf(stderr, "Scan kernel '%s' is not supported on this cpu\n", scan_kernel_name);
+    return 1;
+  }
+
+  if (incremental_state && (core_file || snapshot_file || scan_mode != ScanMode::kHeuristic || sample_rate < 1)) {
+    fprintf(stderr, "--incremental-state only works with a heuristic scan of the live process\n");
+    return 1;
+  }
+  if (incremental_state && !ProcessMemorySource::soft_dirty_supported()) {
+    fprintf(stderr, "The kernel does not track soft-dirty pages, --incremental-state is ignored\n");
+    incremental_state = nullptr;
+  }
+
+  bool sampling = sample_rate < 1;
+  if (sampling && (scan_mode == ScanMode::kHashWalk || scan_mode == ScanMode::kLruWalk)) {
+    fprintf(stderr, "--sample-rate only works with the heuristic and slab-walk scan modes\n");
+    return 1;
+  }
+
+  if (thread_cnt > 1) {
+    // every thread has its own scan buffer
+    scan_buffer_cnt = thread_cnt;
+  }
+  // the dumping processors have the buffers of their dump writers in every scan thread
+  int file_dumper_cnt = 0;
+  for (auto ip : item_processors) {
+    file_dumper_cnt += ip.first->file_dumper_cnt();
+  }
+  uint64_t dump_buffers_size = thread_cnt * file_dumper_cnt * FileDumper::kBufferMemSize;
+  if (!block_size_set) {
+    // the default block size shrinks to leave room for the dump buffers and more threads
+    uint64_t half_left = mem_limit / 2 - min(mem_limit / 2, dump_buffers_size);
+    mem_scan_block_size = min(mem_scan_block_size, half_left / scan_buffer_cnt / MB * MB);
+  }
+  if (scan_buffer_cnt > 1 && scan_buffer_cnt * mem_scan_block_size + dump_buffers_size > mem_limit / 2) {
+    if (thread_cnt == 1 && !scan_buffers_set) {
+      // without reading ahead a single buffer is not limited, as before --scan-buffers
+      scan_buffer_cnt = 1;
+    } else {
+      // leave the other half of memory to processors
+      fprintf(stderr, "%d scan buffers of %lu MB and %lu MB of dump buffers do not fit in half of the %lu MB "
+                      "memory limit, lower --mem-scan-block-size-mb, --scan-buffers or --threads, or raise "
+                      "--mem-limit-mb\n",
+              scan_buffer_cnt, mem_scan_block_size / MB, dump_buffers_size / MB, mem_limit / MB);
+      return 1;
+    }
+  }
+  if (!mem_scan_block_size) {
+    fprintf(stderr, "Scan blocks have to be at least 1 MB, set --mem-scan-block-size-mb or raise the %lu MB "
+                    "--mem-limit-mb\n", mem_limit / MB);
+    return 1;
+  }
+
   for (auto ip : item_processors) {
+    // a single scan buffer may be larger than the limit
+    ip.first->set_mem_limit(mem_limit - min(mem_limit, scan_buffer_cnt * mem_scan_block_size + dump_buffers_size));
     if (!ip.first->init()) {
       fprintf(stderr, "Item processor [%s] failed to initialize.\n", ip.second.c_str());
       return 1;
     }
   }
+  vector<ItemProcessor *> processors;
+  for (auto ip : item_processors) {
+    processors.push_back(ip.first);
+  }
 
-  // this is a mc box, don't OOM and pull down the box!
-  struct rlimit st_mem_limit = {mem_limit, mem_limit};
-  setrlimit(RLIMIT_AS, &st_mem_limit);
-  if (get_mc_server_info(stats_file) < 0) {
-    fprintf(stderr, "%s parse failed\n", stats_file);
+  // a copy of the memory is as old as the stats file taken with it
+  offline_source = core_file || snapshot_file;
+  if (core_file) {
+    memory_source = new CoreMemorySource(core_file);
+  } else if (snapshot_file) {
+    memory_source = new SnapshotMemorySource(snapshot_file);
+  }
+  if (offline_source && !memory_source->init()) {
+    return 1;
+  }
+  // a snapshot keeps the stats file it was taken with
+  string stats;
+  if (stats_file) {
+    ifstream infile(stats_file);
+    stats.assign(istreambuf_iterator<char>(infile), istreambuf_iterator<char>());
+  } else {
+    stats = memory_source->get_stats();
+  }
+  istringstream stats_stream(stats);
+  if (get_mc_server_info(stats_stream) < 0) {
+    fprintf(stderr, "%s parse failed\n", stats_file ? stats_file : "stats in the snapshot");
+    return 1;
+  }
+  item_parser = select_item_parser(!strcmp(item_detector, "header"));
+  datafield_off = item_parser->key_offset;
+  ProcessMemorySource *process_source = nullptr;
+  if (!offline_source) {
+    memory_source = process_source = new ProcessMemorySource(pid);
+    if (!memory_source->init()) {
+      return 1;
+    }
+  }
+
+  bool throttled = max_scan_rate || max_cpu_share > 0 || max_latency_us;
+  if (throttled && offline_source) {
+    fprintf(stderr, "A copy of the memory is read at full speed, the throttle options are ignored\n");
+  } else if (throttled) {
+    scan_throttle = new ScanThrottle(mem_scan_block_size);
+    scan_throttle->set_rate(max_scan_rate);
+    scan_throttle->set_cpu_share(max_cpu_share);
+    if (max_latency_us && !scan_throttle->set_latency_limit(mc_port_arg ? mc_port_arg : mc_port, max_latency_us)) {
+      return 1;
+    }
+  }
+
+  if ((scan_mode == ScanMode::kHashWalk || scan_mode == ScanMode::kLruWalk) && !memory_source->fast_scattered_read()) {
+    fprintf(stderr, "hash-walk and lru-walk are too slow on a compressed snapshot, uncompress it first by "
+                    "--snapshot-file=%s --snapshot-out=$PATH --snapshot-raw\n", snapshot_file);
     return 1;
   }
 
+  // this is a mc box, don't OOM and pull down the box!
+  // a mapped core or snapshot file only takes page cache, which can be reclaimed
+  uint64_t address_space_limit = mem_limit + memory_source->mapped_size();
+  struct rlimit st_mem_limit = {address_space_limit, address_space_limit};
+  setrlimit(RLIMIT_AS, &st_mem_limit);
+  // every malloc arena reserves 64MB of address space, failing to create one under the limit
+  // above makes every allocation of that thread retry mmap. so cap them to a quarter of the limit
+  mallopt(M_ARENA_MAX, max<int>(1, min<uint64_t>(thread_cnt, mem_limit / 4 / (64 * MB))));
+
   const auto kBufSize = mem_scan_block_size;
-  char *pbuf = new char[kBufSize];
-  uint64_t datafield_off = compute_item_datafield_offset();
+  if (snapshot_out) {
+    Timer timer;
+    SnapshotWriter writer(snapshot_out, snapshot_raw ? kSnapshotRaw : kSnapshotZlib);
+    writer.set_throttle(scan_throttle);
+    if (!writer.write(memory_source, stats, kBufSize, scan_buffer_cnt)) {
+      return 1;
+    }
+    timer.stop();
+    fprintf(stderr, "Copied %lu KB memory into %lu KB of %s in %lu us\n",
+            writer.get_total_read() / KB, writer.get_total_written() / KB, snapshot_out, timer.get_us());
+    if (scan_throttle) {
+      scan_throttle->print_summary();
+    }
+    return 0;
+  }
+  if (bench_kernels) {
+    bench_scan_kernels(kBufSize);
+  }
 
   Timer timer;
   uint64_t calculation_time_us = 0;
   uint64_t memscan_time_us = 0;
-
-  const char *current_remote_address = 0;
   uint64_t total_read = 0;
-  for (;;) {
-    // in every iteration get updated address spaces (though it's should rarely change for mc)
-    auto area_list = get_area_list(pid);
-    uint64_t total_mem_size = 0;
-    for (const auto &area : area_list) {
-      total_mem_size += area.size();
-    }
+  uint64_t total_units = 0;
+  uint64_t replayed_item_cnt = 0;
 
-    // continue from the place where stopped in last iteration
-    Area needle = {current_remote_address, current_remote_address};
-    auto it = lower_bound(area_list.begin(), area_list.end(), needle);
-    if (it == area_list.end()) {
-      break;
+  if (scan_mode == ScanMode::kHashWalk) {
+    if (walk_hash_table(hash_table, keys_limit, processors,
+                        &memscan_time_us, &calculation_time_us, &total_read) < 0) {
+      return 1;
     }
-    current_remote_address = max(it->lo, current_remote_address);
-
-    // process_vm_readv accepts reading multiple region in one batch
-    // below is to make up the batch with total size of kBufSize
-    vector<struct iovec> read_region_list;
-    struct iovec local_region = {(void *)pbuf, kBufSize};
-    size_t remote_block_size = min<size_t>(kBufSize, size_t(it->hi - current_remote_address));
-    struct iovec iov = {(void *)current_remote_address, remote_block_size};
-    read_region_list.emplace_back(iov);
-    int64_t bytes_to_read = remote_block_size;
-    it++;
-    for (; it < area_list.end() && bytes_to_read < (signed)kBufSize; it++) {
-      remote_block_size = min<size_t>(kBufSize - bytes_to_read, it->size());
-      struct iovec iov = {(void *)it->lo, remote_block_size};
-      read_region_list.emplace_back(iov);
-      bytes_to_read += remote_block_size;
+  } else if (scan_mode == ScanMode::kLruWalk) {
+    if (walk_lru_lists(lru_walk_from_tail ? lru_tails : lru_heads, lru_walk_from_tail, lru_walk_items,
+                       processors, &memscan_time_us, &calculation_time_us, &total_read) < 0) {
+      return 1;
     }
-
-    timer.reset();
-    // key function of memory copy from external process
-    int read_bytes = process_vm_readv(pid,
-                                      &local_region,
-                                      1,  // one local region
-                                      &read_region_list[0],
-                                      read_region_list.size(),
-                                      0);
-    memscan_time_us += timer.get_us();
-    if (read_bytes) {
-      total_read += read_bytes;
-    }
-    fprintf(stderr, "read %lu KBytes (%.1f%%)\n", read_bytes / KB, total_read * 100.0 / total_mem_size);
-
-    timer.reset();
-    uint32_t bytes_left = read_bytes;
-    for (const auto &i : read_region_list) {
-      if (i.iov_len > bytes_left) {
-        current_remote_address = (char *)((uint64_t)i.iov_base + bytes_left);
-        break;
-      } else {
-        current_remote_address = (char *)((uint64_t)i.iov_base + i.iov_len);
-        bytes_left -= i.iov_len;
-      }
-    }
-
-    unsigned int cur_time = time(nullptr) - server_start_unixtime;
-    for (int i = 0; i < read_bytes - 1; i++) {
-      if (pbuf[i] == ' ' && isdigit(pbuf[i + 1])) {
-        // precondition of there being an item around here: ' ' + a digit
-        int p = i - 2;  // jump over current ' ' and 'null-termination-char' (actually may not be null) of key
-        int possible_key_len = 0;
-        while(p > (int)datafield_off && isprint(pbuf[p]) && pbuf[p] != ' ') {
-          // currently it's assuming the byte just before the key starts is not a printable ascii.
-          // NOTICE: this key boundary detection logic may need to be improved in some cases:
-          // it may miss some keys if the cas is disabled when mc server was started,
-          // or the mc server has been running very very long time, that global cas in mc server
-          // is several times of 2^56, or the machine is in big-endian.
-          possible_key_len++;
-          p--;
-        }
-        p++;
-        item *probed = reinterpret_cast<item*>(pbuf + p - datafield_off);
-        if (possible_key_len < 3 || probed->nkey != possible_key_len) {
-          // key length in struct does not equal to the detected length, it's false positive
-          continue;
-        }
-
-        string detected_key(pbuf + p, probed->nkey);
-        string category_name;
-        size_t delimiter_pos = detected_key.find(category_delimiter);
-        if (delimiter_pos == string::npos) {
-          category_name = "__UNKNOWN_CATEGORY__";
-        } else {
-          category_name = detected_key.substr(0, detected_key.find(category_delimiter));
-        }
-        if (probed->time > 365 * 86400 * 10 || probed->time >= cur_time + 50
-            || (probed->it_flags & 1) == 0   // ITEM_LINKED ( == 0x1) must be set
-            || probed->nbytes + probed->nkey > slabs_info[ITEM_clsid(probed)].unit_size) {
-          // since the item came from raw memory scan, there might be some corrupted entries.
-          // so some sanity checks are applied to filter out them
-          continue;
-        }
-
-        key_cnt_found++;
-        for (auto ip : item_processors) {
-          ip.first->process_item(cur_time,
-                           detected_key,
-                           category_name,
-                           probed->time,
-                           probed->exptime,
-                           probed->nbytes,
-                           ITEM_clsid(probed),
-                           probed->data[0].cas);
-        }
-        i += probed->nbytes;
-      }
+  } else if (incremental_state) {
+    if (incremental_scan(process_source, incremental_state, kBufSize, keys_limit, processors,
+                         &memscan_time_us, &calculation_time_us, &total_read, &replayed_item_cnt) < 0) {
+      return 1;
     }
-    calculation_time_us += timer.get_us();
-
-    if (key_cnt_found > keys_limit) {
-      // for test of small samples
-      break;
+  } else if (sampling) {
+    auto blocks = plan_sample_blocks(memory_source->get_resident_area_list(), kBufSize, sample_rate, sample_seed, &total_units);
+    if (parallel_scan(thread_cnt, kBufSize, keys_limit, blocks, true, processors,
+                      &memscan_time_us, &calculation_time_us, &total_read) < 0) {
+      return 1;
+    }
+  } else if (thread_cnt > 1) {
+    if (parallel_scan(thread_cnt, kBufSize, keys_limit, plan_scan_blocks(memory_source->get_resident_area_list(), kBufSize), false,
+                      processors, &memscan_time_us, &calculation_time_us, &total_read) < 0) {
+      return 1;
     }
+  } else {
+    pipelined_scan(scan_buffer_cnt, kBufSize, keys_limit, processors,
+                   &memscan_time_us, &calculation_time_us, &total_read);
   }
+  timer.stop();
 
-  for (auto ip : item_processors) {
-    delete ip.first;
+  for (auto ip : processors) {
+    if (sampling) {
+      ip->set_sample_size(sampled_units, total_units);
+    }
+    ip->finish();
+    delete ip;
   }
 
-  fprintf(stderr, "Time spent: %lu us_on_mem_scan + %lu us_on_calcuation\n"
+  fprintf(stderr, "Time spent: %lu us_on_mem_scan + %lu us_on_calcuation, %lu us in total\n"
                   "Scanned %lu KB memory, detected %lu keys, that are %.1f%% of keys known by mc server\n",
           memscan_time_us,
           calculation_time_us,
+          timer.get_us(),
           total_read / KB,
-          key_cnt_found,
+          key_cnt_found.load(),
           key_cnt_in_mc ? key_cnt_found * 100.0 / key_cnt_in_mc : 0);
-  delete [] pbuf;
+  if (scan_mode != ScanMode::kHashWalk && scan_mode != ScanMode::kLruWalk) {
+    fprintf(stderr, "Parsed at %.2f GB/s with %s scan kernel, items in the layout of memcached %s found by %s\n",
+            total_read * 1.0 / GB / max<uint64_t>(1, calculation_time_us) * 1000000,
+            scan_kernel->name, item_parser->name, item_parser->detector);
+  }
+  if (sampling) {
+    fprintf(stderr, "Sampled %lu of %lu memory units of %lu KB (seed %u)\n",
+            sampled_units.load(), total_units, kSampleUnitSize / KB, sample_seed);
+  }
+  if (incremental_state) {
+    fprintf(stderr, "%lu keys were taken from the pages not written since the previous scan\n", replayed_item_cnt);
+  }
+  if (zero_page_bytes) {
+    fprintf(stderr, "%lu KB of scanned memory were zero pages and not parsed\n", zero_page_bytes / KB);
+  }
+  if (scan_mode == ScanMode::kSlabWalk) {
+    fprintf(stderr, "Slab walk stepped over %.1f%% of scanned memory by chunk size\n",
+            total_read ? slab_walked_bytes * 100.0 / total_read : 0);
+  }
+  if (scan_throttle) {
+    scan_throttle->print_summary();
+    delete scan_throttle;
+  }
+  delete memory_source;
   return 0;
 }
-
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <string>
+#include <vector>
+
+
+struct Area {
+  const char *lo;
+  const char *hi;
+
+  Area(const char * const lo, const char * const hi) : lo(lo), hi(hi) {}
+
+  // construct an area from "7f7f14000000-7f7f17ffa000" liked string
+  Area(const std::string &s) {
+    uint64_t addr[2] = {0};
+    sscanf(s.c_str(), "%" PRIx64 "-%" PRIx64, &addr[0], &addr[1]);
+    lo = (const char *)(addr[0]);
+    hi = (const char *)(addr[1]);
+  }
+
+  bool operator<(const Area &r) const {
+    // assuming the Area objects have no overlap
+    return lo < r.lo && hi <= r.lo;
+  }
+
+  uint64_t size() const {
+    return hi - lo;
+  }
+};
+
+
+// Where the memory of memcached is read from: the live process, or a copy of it on disk.
+// Addresses are always the ones of the memcached process.
+class MemorySource {
+public:
+  virtual ~MemorySource() {}
+
+  virtual bool init() { return true; }
+  // Private anonymous areas, where memcached allocates its slabs and hash table, sorted by address.
+  virtual std::vector<Area> get_area_list() = 0;
+  // Parts of get_area_list() that hold data, memory that was never touched is left out.
+  virtual std::vector<Area> get_resident_area_list() { return get_area_list(); }
+  // Writable areas of the executable and the anonymous one right after them, holding its globals.
+  virtual std::vector<Area> get_data_area_list() = 0;
+  // Same as process_vm_readv: stops at the first remote region that can not be read,
+  // returns the number of bytes read or -1.
+  virtual ssize_t read(const struct iovec *local, size_t local_cnt,
+                       const struct iovec *remote, size_t remote_cnt) = 0;
+  // Pointer to the content of a remote region that can be used without copying it, or nullptr.
+  virtual const char *direct(const struct iovec &remote) { return nullptr; }
+  // Address of a global symbol of memcached, 0 if it is unknown.
+  virtual uint64_t find_symbol(const std::string &name) { return 0; }
+  // Whether reading many small regions all over the memory is cheap, i.e. hash-walk and lru-walk can be used.
+  virtual bool fast_scattered_read() const { return true; }
+  // Content of the stats file taken along with the memory, empty if there is none.
+  virtual std::string get_stats() { return ""; }
+  // Bytes of address space the source maps by itself, on top of --mem-limit-mb.
+  virtual uint64_t mapped_size() const { return 0; }
+};
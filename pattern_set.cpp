@@ -0,0 +1,116 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pattern_set.h"
+
+#include <deque>
+
+
+using namespace std;
+
+
+PatternSet::PatternSet(Mode mode, const vector<string> &patterns): mode_(mode) {
+  next_.emplace_back();
+  next_[0].fill(0);
+  terminal_.push_back(false);
+  for (auto &pattern : patterns) {
+    add(mode == kSuffix ? string(pattern.rbegin(), pattern.rend()) : pattern);
+  }
+  if (mode == kSubstring) {
+    build_automaton();
+  }
+}
+
+
+void PatternSet::add(const string &pattern) {
+  uint32_t node = 0;
+  for (unsigned char c : pattern) {
+    if (!next_[node][c]) {
+      next_[node][c] = next_.size();
+      next_.emplace_back();
+      next_.back().fill(0);
+      terminal_.push_back(false);
+    }
+    node = next_[node][c];
+  }
+  terminal_[node] = true;
+}
+
+
+void PatternSet::build_automaton() {
+  // breadth first, so the failure target of a node is complete before the node is
+  vector<uint32_t> fail(next_.size(), 0);
+  deque<uint32_t> queue;
+  for (int c = 0; c < 256; c++) {
+    if (next_[0][c]) {
+      queue.push_back(next_[0][c]);
+    }
+  }
+  while (!queue.empty()) {
+    uint32_t node = queue.front();
+    queue.pop_front();
+    if (terminal_[fail[node]]) {
+      terminal_[node] = true;
+    }
+    for (int c = 0; c < 256; c++) {
+      uint32_t child = next_[node][c];
+      if (child) {
+        fail[child] = next_[fail[node]][c];
+        queue.push_back(child);
+      } else {
+        next_[node][c] = next_[fail[node]][c];
+      }
+    }
+  }
+}
+
+
+bool PatternSet::match(const ByteView &key) const {
+  const unsigned char *p = (const unsigned char *)key.data;
+  uint32_t node = 0;
+  switch (mode_) {
+    case kExact:
+      for (size_t i = 0; i < key.size; i++) {
+        if (!(node = next_[node][p[i]])) {
+          return false;
+        }
+      }
+      return terminal_[node];
+    case kPrefix:
+      for (size_t i = 0; i < key.size; i++) {
+        if (terminal_[node] || !(node = next_[node][p[i]])) {
+          break;
+        }
+      }
+      return terminal_[node];
+    case kSuffix:
+      for (size_t i = key.size; i > 0; i--) {
+        if (terminal_[node] || !(node = next_[node][p[i - 1]])) {
+          break;
+        }
+      }
+      return terminal_[node];
+    case kSubstring:
+      for (size_t i = 0; i < key.size; i++) {
+        node = next_[node][p[i]];
+        if (terminal_[node]) {
+          return true;
+        }
+      }
+      return terminal_[0];
+  }
+  return false;
+}
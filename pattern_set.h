@@ -0,0 +1,52 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "item_view.h"
+
+#include <stdint.h>
+
+#include <array>
+#include <string>
+#include <vector>
+
+
+// Matches a key against many patterns at once, in one pass over its bytes. The patterns are kept
+// in a trie, of the reversed patterns for suffixes. For substrings the trie is turned into an
+// Aho-Corasick automaton: every node gets a transition for every byte, following the failure
+// links ahead of time, so a key is matched with one table lookup per byte.
+class PatternSet {
+public:
+  enum Mode {
+    kExact,
+    kPrefix,
+    kSuffix,
+    kSubstring,
+  };
+
+  PatternSet(Mode mode, const std::vector<std::string> &patterns);
+  bool match(const ByteView &key) const;
+
+private:
+  void add(const std::string &pattern);
+  void build_automaton();
+
+  Mode mode_;
+  // transitions of the trie, 0 for none since the root is never a target
+  std::vector<std::array<uint32_t, 256>> next_;
+  // a pattern ends at the node, or at a node on its failure chain for substrings
+  std::vector<bool> terminal_;
+};
@@ -0,0 +1,314 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "prefix_trie.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+
+using namespace std;
+
+
+// min() takes it by reference
+const int PrefixTrie::kMaxSegmentSize;
+
+
+namespace {
+  // a node only gets children once this many items passed it, so the first keys do not expand it
+  const uint64_t kMinItemsToExpand = 100;
+
+  uint32_t segment_hash(const char *segment, size_t size) {
+    // FNV-1a, segments are short
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+      h = (h ^ (uint8_t)segment[i]) * 16777619u;
+    }
+    return h;
+  }
+}
+
+
+PrefixTrie::PrefixTrie(SlabInfo *slabs_info, int max_slab_id) {
+  slabs_info_ = slabs_info;
+  max_slab_id_ = max_slab_id;
+  delimiter_ = ':';
+  max_depth_ = 3;
+  width_ = 32;
+  min_share_ = 0.05;
+  mem_limit_ = 16 * MB;
+  max_nodes_ = 0;
+  sampled_units_ = 0;
+  total_units_ = 0;
+
+  processor_summary_ = "Get the memory and item count of key prefixes down to several delimiter levels";
+  processor_name_ = "prefix trie";
+  args_.emplace_back("--prefix-delimiter=$char", "Delimiter between the levels of a key", ":");
+  args_.emplace_back("--prefix-depth=$NUM", "Number of delimiter levels to break keys down to", "3");
+  args_.emplace_back("--prefix-width=$NUM", "Number of prefixes counted under every prefix", "32");
+  args_.emplace_back("--prefix-min-share=$PERCENT", "Share of its parent's memory a prefix needs to be "
+                                                    "broken down and shown", "5");
+  args_.emplace_back("--prefix-mem-mb=$NUM", "Memory budget of the trie, in MB", "16 (MB)");
+}
+
+
+bool PrefixTrie::set_arg(const char *argv) {
+  const char *val = nullptr;
+  if ((val = is_arg(argv, "--prefix-delimiter="))) {
+    delimiter_ = val[0];
+  } else if ((val = is_arg(argv, "--prefix-depth="))) {
+    max_depth_ = atoi(val);
+  } else if ((val = is_arg(argv, "--prefix-width="))) {
+    width_ = atoi(val);
+  } else if ((val = is_arg(argv, "--prefix-min-share="))) {
+    min_share_ = atof(val) / 100;
+  } else if ((val = is_arg(argv, "--prefix-mem-mb="))) {
+    mem_limit_ = atol(val) * MB;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+bool PrefixTrie::init() {
+  if (max_depth_ < 1 || width_ < 1) {
+    fprintf(stderr, "prefix_depth and prefix_width must be at least 1.\n");
+    return false;
+  }
+  max_nodes_ = mem_limit_ / (sizeof(Node) + width_ * sizeof(Counter));
+  if (max_nodes_ < 1) {
+    fprintf(stderr, "prefix_mem_mb can not hold a single level of %u prefixes.\n", width_);
+    return false;
+  }
+  nodes_.clear();
+  counters_.clear();
+  free_nodes_.clear();
+  // taken at once, growing by doubling could take twice --prefix-mem-mb
+  try {
+    nodes_.reserve(max_nodes_);
+    counters_.reserve(max_nodes_ * width_);
+  } catch (bad_alloc &e) {
+    fprintf(stderr, "prefix_mem_mb of %lu MB can not be allocated.\n", mem_limit_ / MB);
+    return false;
+  }
+  // the root
+  new_node();
+  return true;
+}
+
+
+ItemProcessor *PrefixTrie::clone(int worker_id) const {
+  auto *trie = new PrefixTrie(slabs_info_, max_slab_id_);
+  trie->delimiter_ = delimiter_;
+  trie->max_depth_ = max_depth_;
+  trie->width_ = width_;
+  trie->min_share_ = min_share_;
+  trie->mem_limit_ = mem_limit_;
+  if (!trie->init()) {
+    delete trie;
+    return nullptr;
+  }
+  return trie;
+}
+
+
+void PrefixTrie::merge(ItemProcessor *other) {
+  auto *trie = static_cast<PrefixTrie *>(other);
+  merge_node(0, *trie, 0);
+}
+
+
+void PrefixTrie::merge_node(int32_t node, const PrefixTrie &other, int32_t other_node) {
+  // the counters of the other node are added as if their segments were counted here, with their
+  // own overcount on top of what they take over
+  nodes_[node].items += other.nodes_[other_node].items;
+  nodes_[node].mem += other.nodes_[other_node].mem;
+  for (uint32_t i = 0; i < other.nodes_[other_node].used; i++) {
+    const Counter &theirs = other.counters_[other_node * other.width_ + i];
+    size_t c = count_segment(node, theirs.segment, theirs.size, theirs.items, theirs.mem, theirs.mem_error);
+    if (theirs.child < 0) {
+      continue;
+    }
+    if (counters_[c].child < 0) {
+      int32_t child = new_node();
+      if (child < 0) {
+        continue;
+      }
+      counters_[c].child = child;
+    }
+    merge_node(counters_[c].child, other, theirs.child);
+  }
+}
+
+
+void PrefixTrie::set_sample_size(uint64_t sampled_units, uint64_t total_units) {
+  sampled_units_ = sampled_units;
+  total_units_ = total_units;
+}
+
+
+int32_t PrefixTrie::new_node() {
+  int32_t node;
+  if (!free_nodes_.empty()) {
+    node = free_nodes_.back();
+    free_nodes_.pop_back();
+  } else if (nodes_.size() < max_nodes_) {
+    node = nodes_.size();
+    nodes_.emplace_back();
+    counters_.resize(counters_.size() + width_);
+  } else {
+    return -1;
+  }
+  nodes_[node] = {0, 0, 0};
+  return node;
+}
+
+
+void PrefixTrie::release_node(int32_t node) {
+  for (uint32_t i = 0; i < nodes_[node].used; i++) {
+    if (counters_[node * width_ + i].child >= 0) {
+      release_node(counters_[node * width_ + i].child);
+    }
+  }
+  free_nodes_.push_back(node);
+}
+
+
+size_t PrefixTrie::count_segment(int32_t node, const char *segment, size_t size, uint64_t items, uint64_t mem,
+                                 uint64_t mem_error) {
+  size_t stored = min<size_t>(size, kMaxSegmentSize);
+  uint8_t capped = min<size_t>(size, 255);
+  uint32_t h = segment_hash(segment, stored);
+  Counter *counters = &counters_[node * width_];
+  Node &n = nodes_[node];
+  for (uint32_t i = 0; i < n.used; i++) {
+    if (counters[i].hash == h && counters[i].size == capped && !memcmp(counters[i].segment, segment, stored)) {
+      counters[i].items += items;
+      counters[i].mem += mem;
+      counters[i].mem_error += mem_error;
+      return i + node * width_;
+    }
+  }
+  uint32_t i;
+  if (n.used < width_) {
+    i = n.used++;
+    counters[i] = {};
+  } else {
+    // the least memory is taken over, with everything under it
+    i = 0;
+    for (uint32_t j = 1; j < width_; j++) {
+      if (counters[j].mem < counters[i].mem) {
+        i = j;
+      }
+    }
+    if (counters[i].child >= 0) {
+      release_node(counters[i].child);
+    }
+    items += counters[i].items;
+    mem_error += counters[i].mem;
+    mem += counters[i].mem;
+  }
+  counters[i].hash = h;
+  counters[i].size = capped;
+  memcpy(counters[i].segment, segment, stored);
+  counters[i].child = -1;
+  counters[i].items = items;
+  counters[i].mem = mem;
+  counters[i].mem_error = mem_error;
+  return i + node * width_;
+}
+
+
+bool PrefixTrie::is_heavy(int32_t node, const Counter &counter) const {
+  return counter.mem >= min_share_ * nodes_[node].mem;
+}
+
+
+void PrefixTrie::process_item(unsigned int cur_time, const ItemView &item) {
+  uint64_t mem = slabs_info_[item.slab_id].unit_size;
+  const char *segment = item.key.data;
+  const char *end = item.key.data + item.key.size;
+  int32_t node = 0;
+  for (int depth = 0; node >= 0; depth++) {
+    nodes_[node].items++;
+    nodes_[node].mem += mem;
+    const char *delimiter = depth < max_depth_
+      ? (const char *)memchr(segment, delimiter_, end - segment)
+      : nullptr;
+    if (!delimiter) {
+      // the key ends at this level
+      break;
+    }
+    size_t c = count_segment(node, segment, delimiter - segment, 1, mem, 0);
+    if (counters_[c].child < 0 && depth + 1 < max_depth_
+        && nodes_[node].items >= kMinItemsToExpand && is_heavy(node, counters_[c])) {
+      // keys under the prefix are broken down from now on
+      int32_t child = new_node();
+      counters_[c].child = child;
+    }
+    node = counters_[c].child;
+    segment = delimiter + 1;
+  }
+}
+
+
+void PrefixTrie::print_node(int32_t node, const string &prefix, double scale) const {
+  const Counter *counters = &counters_[node * width_];
+  vector<uint32_t> order;
+  for (uint32_t i = 0; i < nodes_[node].used; i++) {
+    if (is_heavy(node, counters[i])) {
+      order.push_back(i);
+    }
+  }
+  sort(order.begin(), order.end(), [counters](uint32_t a, uint32_t b) { return counters[a].mem > counters[b].mem; });
+  for (auto i : order) {
+    const Counter &counter = counters[i];
+    string name = prefix + string(counter.segment, min<int>(counter.size, kMaxSegmentSize));
+    if (counter.size > kMaxSegmentSize) {
+      name += "...";
+    }
+    name += delimiter_;
+    printf("PREFIX %s\t%.0f\t%.0f\t%.1f\t%.0f\n",
+           name.c_str(),
+           counter.items * scale,
+           counter.mem * scale,
+           counter.mem * 100.0 / nodes_[node].mem,
+           counter.mem_error * scale);
+    // a node that was just taken over has too few keys to tell anything
+    if (counter.child >= 0 && nodes_[counter.child].items >= kMinItemsToExpand) {
+      print_node(counter.child, name, scale);
+    }
+  }
+}
+
+
+void PrefixTrie::finish() {
+  bool sampled = sampled_units_ > 1 && sampled_units_ < total_units_;
+  double scale = sampled ? total_units_ * 1.0 / sampled_units_ : 1;
+  printf("\nKey prefixes down to %d levels with at least %.1f%% of the memory of their parent%s: \n",
+         max_depth_, min_share_ * 100, sampled ? ", estimated from the sample" : "");
+  printf("prefix\t"
+         "Count\t"
+         "mem_used_total\t"
+         "%%_of_parent_mem\t"
+         "mem_overcount_max\n");
+  print_node(0, "", scale);
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "item_aggregator.h"
+#include "item_processor.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+// Memory and item count of key prefixes several delimiter levels deep, e.g. "user:" and below it
+// "user:feed:" and "user:prefs:". Every node of the trie counts the next segment of the keys under
+// its prefix in a fixed number of weighted space-saving counters: a segment that is not counted yet
+// takes over the counter of the least memory, inheriting that memory as its possible overcount.
+// A prefix gets a node of its own once it holds enough of the memory of its parent, and loses it
+// along with its counter. Nodes come from a pool of a fixed size, so the trie stays within its
+// memory budget however many distinct keys there are.
+class PrefixTrie: public ItemProcessor {
+public:
+  PrefixTrie(SlabInfo *slabs_info, int max_slab_id);
+  bool set_arg(const char *argv);
+  bool init();
+  ItemProcessor *clone(int worker_id) const;
+  void merge(ItemProcessor *other);
+  void set_sample_size(uint64_t sampled_units, uint64_t total_units);
+  void finish();
+  void process_item(unsigned int cur_time, const ItemView &item);
+
+private:
+  // longer segments are cut, the ones that only differ after this are counted together
+  static const int kMaxSegmentSize = 47;
+
+  struct Counter {
+    uint32_t hash;
+    // size of the whole segment, capped at 255
+    uint8_t size;
+    char segment[kMaxSegmentSize];
+    // node of the prefixes under this one, -1 if it has none
+    int32_t child;
+    uint64_t items;
+    uint64_t mem;
+    // memory counted for the segments this counter was taken over from
+    uint64_t mem_error;
+  };
+
+  struct Node {
+    uint32_t used;
+    // everything counted at this node, also the keys that end here
+    uint64_t items;
+    uint64_t mem;
+  };
+
+  // Returns the index of the counter of the segment in node, after adding the counts to it.
+  size_t count_segment(int32_t node, const char *segment, size_t size, uint64_t items, uint64_t mem,
+                       uint64_t mem_error);
+  // A new empty node, or -1 if the pool is used up.
+  int32_t new_node();
+  void release_node(int32_t node);
+  bool is_heavy(int32_t node, const Counter &counter) const;
+  void merge_node(int32_t node, const PrefixTrie &other, int32_t other_node);
+  void print_node(int32_t node, const std::string &prefix, double scale) const;
+
+  SlabInfo *slabs_info_;
+  int max_slab_id_;
+  char delimiter_;
+  int max_depth_;
+  uint32_t width_;
+  double min_share_;
+  uint64_t mem_limit_;
+  // node i owns counters_[i * width_, (i + 1) * width_)
+  size_t max_nodes_;
+  std::vector<Node> nodes_;
+  std::vector<Counter> counters_;
+  std::vector<int32_t> free_nodes_;
+  uint64_t sampled_units_;
+  uint64_t total_units_;
+};
@@ -0,0 +1,262 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "process_memory_source.h"
+#include "common.h"
+#include "elf_symbols.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+
+
+using namespace std;
+
+
+namespace {
+  // bit of a /proc/pid/pagemap entry, see Documentation/admin-guide/mm/soft-dirty.rst
+  const uint64_t kPageSoftDirty = 1lu << 55;
+  const uint64_t kPageSwapped = 1lu << 62;
+  const uint64_t kPagePresent = 1lu << 63;
+
+  bool write_clear_refs(const string &path) {
+    // "4" clears only the soft-dirty bits, the referenced bits used by reclaim are left alone
+    int fd = open(path.c_str(), O_WRONLY);
+    if (fd < 0) {
+      return false;
+    }
+    bool ok = write(fd, "4", 1) == 1;
+    close(fd);
+    return ok;
+  }
+}
+
+
+vector<Area> ProcessMemorySource::get_area_list() {
+  lock_guard<mutex> lock(areas_mutex_);
+  refresh_areas();
+  return area_list_;
+}
+
+
+vector<Area> ProcessMemorySource::get_resident_area_list() {
+  lock_guard<mutex> lock(areas_mutex_);
+  refresh_areas();
+  return resident_area_list_;
+}
+
+
+void ProcessMemorySource::refresh_areas() {
+  if (maps_changed_.exchange(false)) {
+    area_list_ = read_maps();
+    resident_area_list_ = find_resident_areas(area_list_);
+  }
+}
+
+
+vector<Area> ProcessMemorySource::read_maps() const {
+  // get address spaces of a pid by reading system file in /proc
+  ifstream infile("/proc/" + to_string(pid_) + "/maps");
+  string line;
+
+  vector<Area> area_list;
+
+  while (getline(infile, line)) {
+    // "7f7f14000000-7f7f17ffa000 rw-p 00000000 00:00 0"
+    uint64_t lo = 0, hi = 0, inode = 0;
+    char perms[5] = {0};
+    if (sscanf(line.c_str(), "%" SCNx64 "-%" SCNx64 " %4s %*s %*s %" SCNu64, &lo, &hi, perms, &inode) == 4
+        && !strcmp(perms, "rw-p") && inode == 0) {
+      // not all memory region store data that we want.
+      // we are looking for private heap area
+      // which has r/w permission and is not mapped from file
+      Area mem_area((const char *)lo, (const char *)hi);
+      if (mem_area.size() < 128 * KB) {
+        continue;
+      }
+      area_list.push_back(mem_area);
+    }
+  }
+  return area_list;
+}
+
+
+vector<Area> ProcessMemorySource::find_resident_areas(const vector<Area> &area_list) const {
+  const uint64_t page_size = getpagesize();
+  // holes up to this size are read along, fewer regions make process_vm_readv faster
+  const uint64_t max_hole_pages = 16;
+  int fd = open(("/proc/" + to_string(pid_) + "/pagemap").c_str(), O_RDONLY);
+  if (fd < 0) {
+    return area_list;
+  }
+  vector<Area> resident_list;
+  vector<uint64_t> entries(64 * KB);
+  for (const auto &area : area_list) {
+    uint64_t page_cnt = area.size() / page_size;
+    uint64_t run_lo = 0, run_hi = 0;
+    bool in_run = false;
+    for (uint64_t i = 0; i < page_cnt; i += entries.size()) {
+      uint64_t cnt = min<uint64_t>(entries.size(), page_cnt - i);
+      uint64_t offset = ((uint64_t)area.lo / page_size + i) * sizeof(uint64_t);
+      if (pread(fd, &entries[0], cnt * sizeof(uint64_t), offset) != ssize_t(cnt * sizeof(uint64_t))) {
+        // take the rest of the area as it is
+        fill(entries.begin(), entries.end(), kPagePresent);
+      }
+      for (uint64_t j = 0; j < cnt; j++) {
+        if (!(entries[j] & (kPagePresent | kPageSwapped))) {
+          continue;
+        }
+        uint64_t page = (uint64_t)area.lo + (i + j) * page_size;
+        if (in_run && page - run_hi <= max_hole_pages * page_size) {
+          run_hi = page + page_size;
+        } else {
+          if (in_run) {
+            resident_list.emplace_back((const char *)run_lo, (const char *)run_hi);
+          }
+          run_lo = page;
+          run_hi = page + page_size;
+          in_run = true;
+        }
+      }
+    }
+    if (in_run) {
+      resident_list.emplace_back((const char *)run_lo, (const char *)run_hi);
+    }
+  }
+  close(fd);
+  return resident_list;
+}
+
+
+vector<Area> ProcessMemorySource::get_data_area_list() {
+  // writable mappings of the executable file, and the anonymous one right after them
+  // that holds the rest of its .bss
+  char exe_path[PATH_MAX] = {0};
+  if (readlink(("/proc/" + to_string(pid_) + "/exe").c_str(), exe_path, sizeof(exe_path) - 1) < 0) {
+    return {};
+  }
+  ifstream infile("/proc/" + to_string(pid_) + "/maps");
+  string line;
+  vector<Area> area_list;
+  bool after_exe = false;
+  while (getline(infile, line)) {
+    auto tokens = split_line(line);
+    if (tokens.size() < 5) {
+      continue;
+    }
+    bool is_exe = tokens.size() >= 6 && tokens[5] == exe_path;
+    if (tokens[1] == "rw-p" && (is_exe || (after_exe && tokens[4] == "0" && tokens.size() == 5))) {
+      Area area(tokens[0]);
+      if (!area_list.empty() && area_list.back().hi == area.lo) {
+        // an array may cross from the file-backed part to the anonymous part
+        area_list.back().hi = area.hi;
+      } else {
+        area_list.push_back(area);
+      }
+    }
+    after_exe = is_exe;
+  }
+  return area_list;
+}
+
+
+ssize_t ProcessMemorySource::read(const struct iovec *local, size_t local_cnt,
+                                  const struct iovec *remote, size_t remote_cnt) {
+  ssize_t read_bytes = process_vm_readv(pid_, local, local_cnt, remote, remote_cnt, 0);
+  uint64_t local_size = 0, remote_size = 0;
+  for (size_t i = 0; i < local_cnt; i++) {
+    local_size += local[i].iov_len;
+  }
+  for (size_t i = 0; i < remote_cnt; i++) {
+    remote_size += remote[i].iov_len;
+  }
+  if (read_bytes < (ssize_t)min(local_size, remote_size)) {
+    // some memory is not mapped anymore
+    maps_changed_ = true;
+  }
+  return read_bytes;
+}
+
+
+uint64_t ProcessMemorySource::find_symbol(const string &name) {
+  return find_process_symbol(pid_, name);
+}
+
+
+bool ProcessMemorySource::soft_dirty_supported() {
+  // without CONFIG_MEM_SOFT_DIRTY clearing still works but no page is ever reported dirty,
+  // so check it on a page of this process
+  const uint64_t page_size = getpagesize();
+  char *page = (char *)aligned_alloc(page_size, page_size);
+  if (!page) {
+    return false;
+  }
+  page[0] = 0;
+  bool supported = false;
+  int fd = open("/proc/self/pagemap", O_RDONLY);
+  if (fd >= 0 && write_clear_refs("/proc/self/clear_refs")) {
+    page[0] = 1;
+    uint64_t entry = 0;
+    supported = pread(fd, &entry, sizeof(entry), (uint64_t)page / page_size * sizeof(entry)) == sizeof(entry)
+      && (entry & kPageSoftDirty);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  free(page);
+  return supported;
+}
+
+
+bool ProcessMemorySource::get_soft_dirty(const Area &area, vector<bool> *dirty) {
+  const uint64_t page_size = getpagesize();
+  int fd = open(("/proc/" + to_string(pid_) + "/pagemap").c_str(), O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Can not open pagemap of %d: %s\n", pid_, strerror(errno));
+    return false;
+  }
+  uint64_t page_cnt = area.size() / page_size;
+  dirty->assign(page_cnt, true);
+  // one entry of 8 bytes per page, read 64K pages at a time
+  vector<uint64_t> entries(64 * KB);
+  bool ok = true;
+  for (uint64_t i = 0; ok && i < page_cnt; i += entries.size()) {
+    uint64_t cnt = min<uint64_t>(entries.size(), page_cnt - i);
+    uint64_t offset = ((uint64_t)area.lo / page_size + i) * sizeof(uint64_t);
+    ok = pread(fd, &entries[0], cnt * sizeof(uint64_t), offset) == ssize_t(cnt * sizeof(uint64_t));
+    for (uint64_t j = 0; ok && j < cnt; j++) {
+      (*dirty)[i + j] = entries[j] & kPageSoftDirty;
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+
+bool ProcessMemorySource::clear_soft_dirty() {
+  if (!write_clear_refs("/proc/" + to_string(pid_) + "/clear_refs")) {
+    fprintf(stderr, "Can not clear soft-dirty bits of %d: %s\n", pid_, strerror(errno));
+    return false;
+  }
+  return true;
+}
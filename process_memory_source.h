@@ -0,0 +1,56 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include "memory_source.h"
+
+#include <atomic>
+#include <mutex>
+
+
+// Reads a running memcached with process_vm_readv, needs PTRACE_ATTACH privilege on it.
+class ProcessMemorySource : public MemorySource {
+public:
+  explicit ProcessMemorySource(pid_t pid) : pid_(pid), maps_changed_(true) {}
+
+  // The areas are read from /proc/pid/maps again only after a read failed, memcached rarely
+  // maps or unmaps memory once it has started.
+  std::vector<Area> get_area_list();
+  std::vector<Area> get_resident_area_list();
+  std::vector<Area> get_data_area_list();
+  ssize_t read(const struct iovec *local, size_t local_cnt, const struct iovec *remote, size_t remote_cnt);
+  uint64_t find_symbol(const std::string &name);
+
+  // Whether the kernel tracks soft-dirty pages, it needs CONFIG_MEM_SOFT_DIRTY.
+  static bool soft_dirty_supported();
+  // Gets from /proc/pid/pagemap whether every page of an area was written since clear_soft_dirty().
+  bool get_soft_dirty(const Area &area, std::vector<bool> *dirty);
+  // Clears the soft-dirty bits of all pages of the process through /proc/pid/clear_refs.
+  bool clear_soft_dirty();
+
+private:
+  void refresh_areas();
+  std::vector<Area> read_maps() const;
+  // Cuts out the pages that are neither present nor swapped out according to /proc/pid/pagemap.
+  std::vector<Area> find_resident_areas(const std::vector<Area> &area_list) const;
+
+  pid_t pid_;
+  std::mutex areas_mutex_;
+  std::vector<Area> area_list_;
+  std::vector<Area> resident_area_list_;
+  std::atomic<bool> maps_changed_;
+};
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "quantile_sketch.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+void QuantileSketch::merge(const QuantileSketch &other) {
+  if (other.counts_.size() > counts_.size()) {
+    counts_.resize(other.counts_.size());
+  }
+  for (size_t i = 0; i < other.counts_.size(); i++) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+}
+
+
+uint32_t QuantileSketch::quantile(double q) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  // the rank-th smallest value, 1-based
+  uint64_t rank = max<uint64_t>(1, ceil(q * count_));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < counts_.size(); i++) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      return bucket_value(i);
+    }
+  }
+  return bucket_value(counts_.size() - 1);
+}
+
+
+uint32_t QuantileSketch::bucket_value(int bucket) {
+  if (bucket < 2 * kSubBucketCnt) {
+    return bucket;
+  }
+  int shift = bucket / kSubBucketCnt - 1;
+  uint64_t lo = uint64_t(bucket % kSubBucketCnt + kSubBucketCnt) << shift;
+  return lo + (uint64_t(1) << shift) / 2;
+}
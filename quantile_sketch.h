@@ -0,0 +1,67 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+// Streaming quantiles of non-negative 32-bit values in bounded memory, a log histogram in the
+// style of HdrHistogram: values below 2 * kSubBucketCnt are counted exactly, larger ones in
+// kSubBucketCnt buckets per power of 2, so a quantile is off by at most 1 / (2 * kSubBucketCnt)
+// of its value. The buckets grow with the largest value seen, up to kMaxBucketCnt counters,
+// no matter how many values are added. Sketches of the same metric can be merged exactly.
+class QuantileSketch {
+public:
+  // 16 buckets per power of 2 keep a sketch within 464 counters, under 2KB, at 3.1% precision:
+  // a category has four of them
+  static const int kSubBucketBits = 4;
+  static const int kSubBucketCnt = 1 << kSubBucketBits;
+  static const int kMaxBucketCnt = (32 - kSubBucketBits + 1) * kSubBucketCnt;
+
+  QuantileSketch(): count_(0) {}
+
+  void add(uint32_t value) {
+    size_t bucket = bucket_of(value);
+    if (bucket >= counts_.size()) {
+      counts_.resize(bucket + 1);
+    }
+    counts_[bucket]++;
+    count_++;
+  }
+  void merge(const QuantileSketch &other);
+  uint64_t count() const { return count_; }
+  // The value that q of all values are at most, for q in [0, 1]. 0 when nothing was added.
+  uint32_t quantile(double q) const;
+
+private:
+  static int bucket_of(uint32_t value) {
+    if (value < 2 * kSubBucketCnt) {
+      return value;
+    }
+    // the top kSubBucketBits + 1 bits of the value, the highest is always set
+    int shift = 31 - __builtin_clz(value) - kSubBucketBits;
+    return (shift + 1) * kSubBucketCnt + int(value >> shift) - kSubBucketCnt;
+  }
+  // the middle of the values of a bucket
+  static uint32_t bucket_value(int bucket);
+
+  // 32 bits are enough, memcached can not hold 2^32 items of one category
+  std::vector<uint32_t> counts_;
+  uint64_t count_;
+};
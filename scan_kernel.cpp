@@ -0,0 +1,270 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scan_kernel.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+using namespace std;
+
+
+namespace {
+  inline bool is_key_char(char c) {
+    // same as isprint(c) && c != ' ' in the "C" locale
+    return c > 0x20 && c < 0x7f;
+  }
+
+  uint64_t find_markers_scalar(const char *p) {
+    uint64_t mask = 0;
+    for (int j = 0; j < 64; j++) {
+      if (p[j] == ' ' && isdigit(p[j + 1])) {
+        mask |= 1lu << j;
+      }
+    }
+    return mask;
+  }
+
+  int key_span_scalar(const char *buf, int p, int lo) {
+    int span = 0;
+    while (p > lo && is_key_char(buf[p]) && span < kMaxKeySpan) {
+      span++;
+      p--;
+    }
+    return span;
+  }
+
+  inline bool word_matches(const char *p, const WordSignature &sig) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    // the bytes that may be 0 are set to 0xff, then a byte is 0 iff its subtraction borrows
+    uint64_t tested = word | ~sig.nonzero_bytes;
+    uint64_t zero_bytes = (tested - 0x0101010101010101lu) & ~tested & 0x8080808080808080lu;
+    return (word & sig.mask) == sig.value && zero_bytes == 0;
+  }
+
+  uint32_t match_words_scalar(const char *p, const WordSignature *sigs, int cnt) {
+    return match_words_tail(p, 8, sigs, cnt);
+  }
+
+  bool is_zero_scalar(const char *p) {
+    auto words = reinterpret_cast<const uint64_t *>(p);
+    uint64_t bits = 0;
+    for (size_t i = 0; i < kZeroCheckSize / sizeof(uint64_t); i++) {
+      bits |= words[i];
+    }
+    return bits == 0;
+  }
+
+#if defined(__x86_64__)
+  // sse2 is always there on x86_64
+  inline uint32_t marker_mask_16(const char *p) {
+    __m128i cur = _mm_loadu_si128((const __m128i *)p);
+    __m128i next = _mm_loadu_si128((const __m128i *)(p + 1));
+    __m128i space = _mm_cmpeq_epi8(cur, _mm_set1_epi8(' '));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(next, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(next, _mm_set1_epi8('9' + 1)));
+    return _mm_movemask_epi8(_mm_and_si128(space, digit));
+  }
+
+  uint64_t find_markers_sse2(const char *p) {
+    return uint64_t(marker_mask_16(p))
+      | uint64_t(marker_mask_16(p + 16)) << 16
+      | uint64_t(marker_mask_16(p + 32)) << 32
+      | uint64_t(marker_mask_16(p + 48)) << 48;
+  }
+
+  int key_span_sse2(const char *buf, int p, int lo) {
+    int span = 0;
+    // signed compare: bytes >= 0x80 are negative so they fail the lower bound
+    while (p - 15 > lo && span < kMaxKeySpan) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(buf + p - 15));
+      __m128i key_chars = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x20)),
+                                        _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+      uint32_t others = ~_mm_movemask_epi8(key_chars) & 0xffff;
+      if (others) {
+        // highest non-key byte is where the span stops
+        return min(kMaxKeySpan, span + 15 - (31 - __builtin_clz(others)));
+      }
+      span += 16;
+      p -= 16;
+    }
+    return min(kMaxKeySpan, span + key_span_scalar(buf, p, lo));
+  }
+
+  uint32_t match_words_sse2(const char *p, const WordSignature *sigs, int cnt) {
+    uint32_t matches = 0xff;
+    for (int s = 0; s < cnt && matches; s++) {
+      __m128i mask = _mm_set1_epi64x(sigs[s].mask);
+      __m128i value = _mm_set1_epi64x(sigs[s].value);
+      __m128i may_be_zero = _mm_set1_epi64x(~sigs[s].nonzero_bytes);
+      uint32_t sig_matches = 0;
+      for (int j = 0; j < 4; j++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + sigs[s].offset + j * 16));
+        // a word matches if all its bytes are 0 here
+        __m128i bad = _mm_or_si128(_mm_xor_si128(_mm_and_si128(v, mask), value),
+                                   _mm_cmpeq_epi8(_mm_or_si128(v, may_be_zero), _mm_setzero_si128()));
+        uint32_t good_bytes = _mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128()));
+        sig_matches |= ((good_bytes & 0xff) == 0xff) << (j * 2);
+        sig_matches |= ((good_bytes >> 8) == 0xff) << (j * 2 + 1);
+      }
+      matches &= sig_matches;
+    }
+    return matches;
+  }
+
+  bool is_zero_sse2(const char *p) {
+    // a page with data is usually told apart in the first bytes
+    for (int i = 0; i < kZeroCheckSize; i += 64) {
+      __m128i bits = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i)),
+                                               _mm_loadu_si128((const __m128i *)(p + i + 16))),
+                                  _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i + 32)),
+                                               _mm_loadu_si128((const __m128i *)(p + i + 48))));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128())) != 0xffff) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  __attribute__((target("avx2")))
+  uint64_t find_markers_avx2(const char *p) {
+    uint64_t mask = 0;
+    for (int half = 0; half < 2; half++) {
+      __m256i cur = _mm256_loadu_si256((const __m256i *)(p + half * 32));
+      __m256i next = _mm256_loadu_si256((const __m256i *)(p + half * 32 + 1));
+      __m256i space = _mm256_cmpeq_epi8(cur, _mm256_set1_epi8(' '));
+      __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(next, _mm256_set1_epi8('0' - 1)),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), next));
+      mask |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_and_si256(space, digit)))) << (half * 32);
+    }
+    return mask;
+  }
+
+  __attribute__((target("avx2")))
+  int key_span_avx2(const char *buf, int p, int lo) {
+    int span = 0;
+    while (p - 31 > lo && span < kMaxKeySpan) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(buf + p - 31));
+      __m256i key_chars = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x20)),
+                                           _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7f), v));
+      uint32_t others = ~uint32_t(_mm256_movemask_epi8(key_chars));
+      if (others) {
+        return min(kMaxKeySpan, span + 31 - (31 - __builtin_clz(others)));
+      }
+      span += 32;
+      p -= 32;
+    }
+    return min(kMaxKeySpan, span + key_span_scalar(buf, p, lo));
+  }
+
+  __attribute__((target("avx2")))
+  uint32_t match_words_avx2(const char *p, const WordSignature *sigs, int cnt) {
+    uint32_t matches = 0xff;
+    for (int s = 0; s < cnt && matches; s++) {
+      __m256i mask = _mm256_set1_epi64x(sigs[s].mask);
+      __m256i value = _mm256_set1_epi64x(sigs[s].value);
+      __m256i may_be_zero = _mm256_set1_epi64x(~sigs[s].nonzero_bytes);
+      uint32_t sig_matches = 0;
+      for (int half = 0; half < 2; half++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + sigs[s].offset + half * 32));
+        __m256i bad = _mm256_or_si256(_mm256_xor_si256(_mm256_and_si256(v, mask), value),
+                                      _mm256_cmpeq_epi8(_mm256_or_si256(v, may_be_zero), _mm256_setzero_si256()));
+        __m256i good = _mm256_cmpeq_epi64(bad, _mm256_setzero_si256());
+        sig_matches |= uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(good))) << (half * 4);
+      }
+      matches &= sig_matches;
+    }
+    return matches;
+  }
+
+  __attribute__((target("avx2")))
+  bool is_zero_avx2(const char *p) {
+    for (int i = 0; i < kZeroCheckSize; i += 128) {
+      __m256i bits = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256((const __m256i *)(p + i)),
+                                                     _mm256_loadu_si256((const __m256i *)(p + i + 32))),
+                                     _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(p + i + 64)),
+                                                     _mm256_loadu_si256((const __m256i *)(p + i + 96))));
+      if (!_mm256_testz_si256(bits, bits)) {
+        return false;
+      }
+    }
+    return true;
+  }
+#endif
+
+  const ScanKernel kScalarKernel = {"scalar", find_markers_scalar, key_span_scalar, match_words_scalar, is_zero_scalar};
+#if defined(__x86_64__)
+  const ScanKernel kSse2Kernel = {"sse2", find_markers_sse2, key_span_sse2, match_words_sse2, is_zero_sse2};
+  const ScanKernel kAvx2Kernel = {"avx2", find_markers_avx2, key_span_avx2, match_words_avx2, is_zero_avx2};
+#endif
+}
+
+
+uint64_t find_markers_tail(const char *p, int len) {
+  uint64_t mask = 0;
+  for (int j = 0; j < len; j++) {
+    if (p[j] == ' ' && isdigit(p[j + 1])) {
+      mask |= 1lu << j;
+    }
+  }
+  return mask;
+}
+
+
+uint32_t match_words_tail(const char *p, int pos_cnt, const WordSignature *sigs, int cnt) {
+  uint32_t matches = 0;
+  for (int k = 0; k < pos_cnt; k++) {
+    bool match = true;
+    for (int s = 0; s < cnt && match; s++) {
+      match = word_matches(p + k * 8 + sigs[s].offset, sigs[s]);
+    }
+    matches |= uint32_t(match) << k;
+  }
+  return matches;
+}
+
+
+vector<const ScanKernel *> available_scan_kernels() {
+  vector<const ScanKernel *> kernels;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back(&kAvx2Kernel);
+  }
+  kernels.push_back(&kSse2Kernel);
+#endif
+  kernels.push_back(&kScalarKernel);
+  return kernels;
+}
+
+
+const ScanKernel *select_scan_kernel(const char *name) {
+  auto kernels = available_scan_kernels();
+  if (!strcmp(name, "auto")) {
+    return kernels[0];
+  }
+  for (auto kernel : kernels) {
+    if (!strcmp(name, kernel->name)) {
+      return kernel;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <stdint.h>
+
+#include <vector>
+
+
+// An 8-byte word at offset from a tested position matches if (word & mask) == value
+// and none of the bytes set in nonzero_bytes is 0.
+struct WordSignature {
+  int offset;
+  uint64_t mask;
+  uint64_t value;
+  uint64_t nonzero_bytes;
+};
+
+
+// Byte search primitives of the item detection loop, with one implementation per instruction set.
+// All kernels give exactly the same results as the plain C loop they replace.
+struct ScanKernel {
+  const char *name;
+  // Bit j of the result is set if p[j] == ' ' and p[j + 1] is a digit, for j in [0, 64).
+  // p[0] to p[64] must be readable.
+  uint64_t (*find_markers)(const char *p);
+  // Number of consecutive bytes that can be part of a key (printable and not ' '),
+  // counting backwards from buf[p] but not reaching buf[lo]. Stops counting at kMaxKeySpan.
+  int (*key_span)(const char *buf, int p, int lo);
+  // Bit k of the result is set if the words at p + 8 * k match all the cnt signatures, for k in [0, 8).
+  // p[0] to p[63 + offset] must be readable for the largest offset of the signatures.
+  uint32_t (*match_words)(const char *p, const WordSignature *sigs, int cnt);
+  // Whether the kZeroCheckSize bytes from p are all zero, such memory can not hold an item.
+  bool (*is_zero)(const char *p);
+};
+
+// a page, never touched memory is zero a page at a time
+const int kZeroCheckSize = 4096;
+
+// nkey of an item is one byte, no longer span can be a key
+const int kMaxKeySpan = 256;
+
+// find_markers() of the last bytes of a buffer: only p[0] to p[len] are readable, len < 64.
+uint64_t find_markers_tail(const char *p, int len);
+
+// match_words() of the last positions of a buffer: only the first pos_cnt are tested, pos_cnt < 8.
+uint32_t match_words_tail(const char *p, int pos_cnt, const WordSignature *sigs, int cnt);
+
+// Kernels supported by the running cpu, the fastest one first.
+std::vector<const ScanKernel *> available_scan_kernels();
+// Returns the kernel of the given name, or the fastest one if name is "auto"; nullptr if not supported.
+const ScanKernel *select_scan_kernel(const char *name);
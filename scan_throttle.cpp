@@ -0,0 +1,205 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "scan_throttle.h"
+#include "common.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <thread>
+
+
+using namespace std;
+
+
+namespace {
+  const uint64_t kMinBlockSize = MB;
+  const uint64_t kMinPauseUs = 10000;
+  const uint64_t kMaxPauseUs = 1000000;
+  const int kBaselineProbeCnt = 5;
+}
+
+
+ScanThrottle::ScanThrottle(uint64_t max_block_size)
+  : max_block_size_(max_block_size),
+    min_block_size_(min(max_block_size, kMinBlockSize)),
+    block_size_(max_block_size),
+    bytes_per_sec_(0),
+    tokens_(max_block_size),
+    refilled_us_(0),
+    cpu_share_(0),
+    sock_fd_(-1),
+    latency_limit_us_(0),
+    baseline_us_(numeric_limits<uint64_t>::max()),
+    pause_us_(0),
+    slept_us_(0),
+    probe_cnt_(0),
+    slow_probe_cnt_(0),
+    max_latency_us_(0),
+    smallest_block_size_(max_block_size) {
+}
+
+
+ScanThrottle::~ScanThrottle() {
+  if (sock_fd_ >= 0) {
+    close(sock_fd_);
+  }
+}
+
+
+bool ScanThrottle::set_latency_limit(int port, uint64_t latency_limit_us) {
+  sock_fd_ = socket_connect(port);
+  if (sock_fd_ < 0) {
+    return false;
+  }
+  int one = 1;
+  setsockopt(sock_fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  // a memcached too slow to answer in a second is surely overloaded, stop probing it then
+  struct timeval timeout = {1, 0};
+  setsockopt(sock_fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  latency_limit_us_ = latency_limit_us;
+  // the fastest of a few round trips before the scan is what memcached does when it is left alone
+  for (int i = 0; i < kBaselineProbeCnt; i++) {
+    uint64_t latency_us = probe();
+    if (!latency_us) {
+      fprintf(stderr, "Can not get the version of memcached on port %d\n", port);
+      return false;
+    }
+    baseline_us_ = min(baseline_us_, latency_us);
+  }
+  probe_cnt_ = 0;
+  max_latency_us_ = 0;
+  return true;
+}
+
+
+uint64_t ScanThrottle::block_size() {
+  lock_guard<mutex> guard(lock_);
+  return block_size_;
+}
+
+
+void ScanThrottle::before_read(uint64_t bytes) {
+  lock_guard<mutex> guard(lock_);
+  if (pause_us_) {
+    sleep_us(pause_us_);
+  }
+
+  if (bytes_per_sec_) {
+    // tokens are allowed to go negative for a block larger than the bucket,
+    // the debt is paid by sleeping till it is refilled
+    uint64_t now_us = clock_.get_us();
+    tokens_ = min<double>(max_block_size_, tokens_ + (now_us - refilled_us_) * 1e-6 * bytes_per_sec_);
+    refilled_us_ = now_us;
+    tokens_ -= bytes;
+    if (tokens_ < 0) {
+      sleep_us(-tokens_ * 1e6 / bytes_per_sec_);
+    }
+  }
+
+  if (cpu_share_ > 0) {
+    // all threads of the inspector count, as they all take the same cpu from memcached
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000lu
+                      + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+    uint64_t allowed_wall_us = cpu_us / cpu_share_;
+    uint64_t wall_us = clock_.get_us();
+    if (allowed_wall_us > wall_us) {
+      sleep_us(allowed_wall_us - wall_us);
+    }
+  }
+}
+
+
+void ScanThrottle::after_read() {
+  lock_guard<mutex> guard(lock_);
+  if (sock_fd_ < 0) {
+    return;
+  }
+  uint64_t latency_us = probe();
+  if (!latency_us) {
+    fprintf(stderr, "Latency probe of memcached failed, the scan goes on without it\n");
+    close(sock_fd_);
+    sock_fd_ = -1;
+    return;
+  }
+  probe_cnt_++;
+  max_latency_us_ = max(max_latency_us_, latency_us);
+  baseline_us_ = min(baseline_us_, latency_us);
+
+  if (latency_us > baseline_us_ + latency_limit_us_) {
+    slow_probe_cnt_++;
+    block_size_ = max(min_block_size_, block_size_ / 2 / kMinBlockSize * kMinBlockSize);
+    pause_us_ = min(kMaxPauseUs, max(kMinPauseUs, pause_us_ * 2));
+    smallest_block_size_ = min(smallest_block_size_, block_size_);
+  } else {
+    block_size_ = min(max_block_size_, max(block_size_ + kMinBlockSize, block_size_ / 4 * 5 / kMinBlockSize * kMinBlockSize));
+    pause_us_ = pause_us_ / 2 >= kMinPauseUs ? pause_us_ / 2 : 0;
+  }
+}
+
+
+void ScanThrottle::print_summary() const {
+  fprintf(stderr, "Throttled the scan by sleeping %lu us", slept_us_);
+  if (probe_cnt_) {
+    fprintf(stderr, ", %lu of %lu latency probes were over %lu us (fastest %lu us, slowest %lu us), "
+                    "blocks went down to %lu KBytes",
+            slow_probe_cnt_, probe_cnt_, baseline_us_ + latency_limit_us_, baseline_us_, max_latency_us_,
+            smallest_block_size_ / KB);
+  }
+  fprintf(stderr, "\n");
+}
+
+
+uint64_t ScanThrottle::probe() {
+  static const char kCommand[] = "version\r\n";
+  Timer timer;
+  if (write(sock_fd_, kCommand, sizeof(kCommand) - 1) != sizeof(kCommand) - 1) {
+    return 0;
+  }
+  // the answer is a single line, e.g. "VERSION 1.4.36\r\n"
+  char buf[256];
+  size_t len = 0;
+  while (len < 2 || buf[len - 2] != '\r' || buf[len - 1] != '\n') {
+    ssize_t ret = read(sock_fd_, buf + len, sizeof(buf) - len);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0 || (len += ret) == sizeof(buf)) {
+      return 0;
+    }
+  }
+  return max<uint64_t>(1, timer.get_us());
+}
+
+
+void ScanThrottle::sleep_us(uint64_t us) {
+  this_thread::sleep_for(chrono::microseconds(us));
+  slept_us_ += us;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <stdint.h>
+
+#include <mutex>
+
+#include "timer.h"
+
+
+// Paces the copy of memcached's memory, so a scan does not take the memory bandwidth and cache
+// memcached needs to serve requests in time. Any combination of the limits below can be set:
+//  - a rate of bytes per second, as a token bucket of up to one block,
+//  - a share of one cpu for the inspector's own user and system time,
+//  - a limit on the round trip time of a 'version' command to memcached, probed after every block.
+//    The block size is halved and a pause between blocks doubled while the round trip is slower
+//    than the fastest one seen plus the limit, and both are restored step by step once it is not.
+// All methods can be called from multiple scanning threads.
+class ScanThrottle {
+public:
+  ScanThrottle(uint64_t max_block_size);
+  ~ScanThrottle();
+
+  void set_rate(uint64_t bytes_per_sec) { bytes_per_sec_ = bytes_per_sec; }
+  void set_cpu_share(double cpu_share) { cpu_share_ = cpu_share; }
+  // Connects to memcached on the port and takes the baseline round trip. Returns false on error.
+  bool set_latency_limit(int port, uint64_t latency_limit_us);
+  bool enabled() const { return bytes_per_sec_ || cpu_share_ > 0 || sock_fd_ >= 0; }
+
+  // Size of the next block, it is the max block size unless latency made it smaller.
+  uint64_t block_size();
+  // Waits till a block of bytes can be read.
+  void before_read(uint64_t bytes);
+  // Probes the latency after a block is read and adapts block size and pause to it.
+  void after_read();
+  void print_summary() const;
+
+private:
+  // Returns the round trip time of a 'version' command in us, 0 on error.
+  uint64_t probe();
+  void sleep_us(uint64_t us);
+
+  std::mutex lock_;
+  Timer clock_;
+  uint64_t max_block_size_;
+  uint64_t min_block_size_;
+  uint64_t block_size_;
+
+  uint64_t bytes_per_sec_;
+  double tokens_;
+  uint64_t refilled_us_;
+
+  double cpu_share_;
+
+  int sock_fd_;
+  uint64_t latency_limit_us_;
+  uint64_t baseline_us_;
+  uint64_t pause_us_;
+
+  uint64_t slept_us_;
+  uint64_t probe_cnt_;
+  uint64_t slow_probe_cnt_;
+  uint64_t max_latency_us_;
+  uint64_t smallest_block_size_;
+};
@@ -0,0 +1,333 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "item_layout.h"
+#include "slab_optimizer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+
+using namespace std;
+
+
+namespace {
+  // MAX_NUMBER_OF_SLAB_CLASSES of memcached, the classes are 1 to 63 and the last is the largest chunk
+  const int kMaxSlabClasses = 63;
+}
+
+
+SlabOptimizer::SlabOptimizer(SlabInfo *slabs_info, int max_slab_id):
+  slabs_info_(slabs_info),
+  max_slab_id_(max_slab_id),
+  classes_(0),
+  max_chunk_(0),
+  large_items_(0),
+  large_bytes_(0),
+  sampled_units_(0),
+  total_units_(0) {
+  processor_summary_ = "Memory wasted by the slab classes, and the -f growth factor and chunk sizes that waste the least";
+  processor_name_ = "slab optimizer";
+  args_.emplace_back("--slab-classes=$NUM", "Number of classes to find the best chunk sizes and growth factor for",
+                     "(AS MANY AS NOW)");
+}
+
+
+bool SlabOptimizer::set_arg(const char *argv) {
+  const char *val = nullptr;
+  if ((val = is_arg(argv, "--slab-classes="))) {
+    classes_ = min(atoi(val), kMaxSlabClasses);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+ItemProcessor *SlabOptimizer::clone(int worker_id) const {
+  auto *optimizer = new SlabOptimizer(slabs_info_, max_slab_id_);
+  optimizer->classes_ = classes_;
+  return optimizer;
+}
+
+
+void SlabOptimizer::size_histogram() {
+  // the stats are read after init(), so this is done on the first item
+  for (int i = 0; i < max_slab_id_; i++) {
+    max_chunk_ = max(max_chunk_, slabs_info_[i].unit_size);
+  }
+  bin_items_.assign(max_chunk_ / kBinBytes + 1, 0);
+  bin_bytes_.assign(max_chunk_ / kBinBytes + 1, 0);
+  slab_use_.assign(max_slab_id_, SlabUse{0, 0});
+}
+
+
+void SlabOptimizer::merge(ItemProcessor *other) {
+  auto *optimizer = static_cast<SlabOptimizer *>(other);
+  if (optimizer->bin_items_.empty()) {
+    return;
+  }
+  if (bin_items_.empty()) {
+    size_histogram();
+  }
+  for (size_t b = 0; b < bin_items_.size(); b++) {
+    bin_items_[b] += optimizer->bin_items_[b];
+    bin_bytes_[b] += optimizer->bin_bytes_[b];
+  }
+  for (int i = 0; i < max_slab_id_; i++) {
+    slab_use_[i].items += optimizer->slab_use_[i].items;
+    slab_use_[i].item_size += optimizer->slab_use_[i].item_size;
+  }
+  large_items_ += optimizer->large_items_;
+  large_bytes_ += optimizer->large_bytes_;
+}
+
+
+void SlabOptimizer::process_item(unsigned int cur_time, const ItemView &item) {
+  if (bin_items_.empty()) {
+    size_histogram();
+  }
+  if (item.slab_id >= 0 && item.slab_id < max_slab_id_) {
+    slab_use_[item.slab_id].items++;
+    slab_use_[item.slab_id].item_size += item.total_size;
+  }
+  if (item.total_size > max_chunk_) {
+    large_items_++;
+    large_bytes_ += item.total_size;
+    return;
+  }
+  uint64_t bin = (item.total_size + kBinBytes - 1) / kBinBytes;
+  bin_items_[bin]++;
+  bin_bytes_[bin] += item.total_size;
+}
+
+
+void SlabOptimizer::set_sample_size(uint64_t sampled_units, uint64_t total_units) {
+  sampled_units_ = sampled_units;
+  total_units_ = total_units;
+}
+
+
+double SlabOptimizer::chunk_mem(uint64_t chunk) {
+  return chunk < kSlabPageSize ? double(kSlabPageSize) / (kSlabPageSize / chunk) : chunk;
+}
+
+
+double SlabOptimizer::group_mem(uint64_t lo_bin, uint64_t hi_bin) const {
+  return (items_below_[hi_bin] - items_below_[lo_bin]) * chunk_mem(hi_bin * kBinBytes);
+}
+
+
+double SlabOptimizer::config_mem(const vector<uint64_t> &chunks) const {
+  double mem = 0;
+  uint64_t lo_bin = 0;
+  for (uint64_t chunk : chunks) {
+    uint64_t hi_bin = min<uint64_t>(chunk / kBinBytes, items_below_.size() - 1);
+    if (hi_bin > lo_bin) {
+      mem += group_mem(lo_bin, hi_bin);
+      lo_bin = hi_bin;
+    }
+  }
+  return mem;
+}
+
+
+vector<uint64_t> SlabOptimizer::growth_factor_chunks(double factor, uint64_t min_size) const {
+  // slabs_init() of memcached
+  vector<uint64_t> chunks;
+  unsigned int size = kItemHeaderSize + min_size;
+  for (int i = 1; i < kMaxSlabClasses && size < max_chunk_ / factor; i++) {
+    if (size % kBinBytes) {
+      size += kBinBytes - size % kBinBytes;
+    }
+    chunks.push_back(size);
+    size *= factor;
+  }
+  chunks.push_back(max_chunk_);
+  return chunks;
+}
+
+
+SlabOptimizer::Config SlabOptimizer::best_growth_factor(size_t max_classes) const {
+  Config best = {"growth_factor", "", {}};
+  double best_mem = numeric_limits<double>::max();
+  char options[64];
+  for (int percent = 101; percent <= 200; percent++) {
+    for (uint64_t min_size = 8; min_size <= 512; min_size += 8) {
+      auto chunks = growth_factor_chunks(percent / 100.0, min_size);
+      double mem = chunks.size() <= max_classes ? config_mem(chunks) : best_mem;
+      if (mem < best_mem) {
+        best_mem = mem;
+        snprintf(options, sizeof(options), "-f %.2f -n %lu", percent / 100.0, min_size);
+        best.options = options;
+        best.chunks.swap(chunks);
+      }
+    }
+  }
+  return best;
+}
+
+
+SlabOptimizer::Config SlabOptimizer::optimal_chunks(size_t classes) const {
+  // the upper bins of the classes are among the bins that have items, the last one is the
+  // largest chunk. mem[k][j] is the least memory of the items of the first j candidates in k
+  // classes. The cost of a class is Monge, so the best split point only moves right as j grows
+  // and every row is found by divide and conquer in O(M log M).
+  vector<uint64_t> candidates;
+  uint64_t max_bin = items_below_.size() - 1;
+  for (uint64_t b = 1; b < max_bin; b++) {
+    if (bin_items_[b]) {
+      candidates.push_back(b);
+    }
+  }
+  candidates.push_back(max_bin);
+  size_t m = candidates.size();
+  classes = min(classes, m);
+  auto upper_bin = [&](size_t j) { return j ? candidates[j - 1] : 0; };
+
+  const double kInf = numeric_limits<double>::max();
+  vector<double> prev(m + 1, kInf), cur(m + 1, kInf);
+  prev[0] = 0;
+  vector<uint32_t> split((classes + 1) * (m + 1), 0);
+  for (size_t k = 1; k <= classes; k++) {
+    fill(cur.begin(), cur.end(), kInf);
+    // a stack instead of recursion: (j_lo, j_hi, i_lo, i_hi)
+    vector<array<size_t, 4>> ranges = {{k, m, k - 1, m - 1}};
+    while (!ranges.empty()) {
+      auto range = ranges.back();
+      ranges.pop_back();
+      if (range[0] > range[1]) {
+        continue;
+      }
+      size_t j = (range[0] + range[1]) / 2;
+      size_t best_i = range[2];
+      for (size_t i = range[2]; i <= min(j - 1, range[3]); i++) {
+        double mem = prev[i] + group_mem(upper_bin(i), upper_bin(j));
+        if (mem < cur[j]) {
+          cur[j] = mem;
+          best_i = i;
+        }
+      }
+      split[k * (m + 1) + j] = best_i;
+      ranges.push_back({range[0], j - 1, range[2], best_i});
+      ranges.push_back({j + 1, range[1], best_i, range[3]});
+    }
+    prev.swap(cur);
+  }
+
+  Config optimal = {"optimal_sizes", "-o slab_sizes=", {}};
+  for (size_t k = classes, j = m; k > 0; j = split[k * (m + 1) + j], k--) {
+    optimal.chunks.push_back(upper_bin(j) * kBinBytes);
+  }
+  reverse(optimal.chunks.begin(), optimal.chunks.end());
+  // memcached adds the largest chunk after the sizes given
+  for (size_t i = 0; i + 1 < optimal.chunks.size(); i++) {
+    optimal.options += (i ? "-" : "") + to_string(optimal.chunks[i]);
+  }
+  if (optimal.chunks.size() < 2) {
+    // only the largest chunk, which needs no option
+    optimal.options = "-";
+  }
+  return optimal;
+}
+
+
+void SlabOptimizer::finish() {
+  if (bin_items_.empty()) {
+    size_histogram();
+  }
+  bool sampled = sampled_units_ > 1 && sampled_units_ < total_units_;
+  double scale = sampled ? total_units_ * 1.0 / sampled_units_ : 1;
+
+  printf("\nMemory wasted by slab classes%s: \n", sampled ? ", estimated from the sample" : "");
+  printf("slab_id\t"
+         "slot_size\t"
+         "Count\t"
+         "item_size_total\t"
+         "mem_used_total\t"
+         "mem_wasted_total\t"
+         "%%_of_mem_wasted\n");
+  size_t class_cnt = 0;
+  for (int i = 0; i < max_slab_id_; i++) {
+    class_cnt += slabs_info_[i].unit_size ? 1 : 0;
+    const auto &use = slab_use_[i];
+    if (!use.items || !slabs_info_[i].unit_size) {
+      continue;
+    }
+    // items larger than the slot are chunked, they only waste the tail of their last chunk
+    uint64_t mem = max(use.items * slabs_info_[i].unit_size, use.item_size);
+    printf("SLABUSE %d\t%lu\t%.0f\t%.0f\t%.0f\t%.0f\t%.1f\n",
+           i,
+           slabs_info_[i].unit_size,
+           use.items * scale,
+           use.item_size * scale,
+           mem * scale,
+           (mem - use.item_size) * scale,
+           (mem - use.item_size) * 100.0 / mem);
+  }
+
+  items_below_.assign(bin_items_.size(), 0);
+  uint64_t item_size = 0;
+  for (size_t b = 0; b < bin_items_.size(); b++) {
+    items_below_[b] = (b ? items_below_[b - 1] : 0) + bin_items_[b];
+    item_size += bin_bytes_[b];
+  }
+  if (!class_cnt || !items_below_.back()) {
+    return;
+  }
+  size_t classes = classes_ ? classes_ : class_cnt;
+  Config current = {"current", "-", {}};
+  for (int i = 0; i < max_slab_id_; i++) {
+    if (slabs_info_[i].unit_size) {
+      current.chunks.push_back(slabs_info_[i].unit_size);
+    }
+  }
+  sort(current.chunks.begin(), current.chunks.end());
+  double current_mem = config_mem(current.chunks);
+
+  printf("\nMemory of the items up to %lu bytes with other chunk sizes, of at most %zu classes, "
+         "counting the unused tail of every %lu KB page: \n",
+         max_chunk_, classes, kSlabPageSize / KB);
+  if (large_items_) {
+    printf("%.0f larger items of %.0f bytes are left out\n", large_items_ * scale, large_bytes_ * scale);
+  }
+  printf("config\t"
+         "classes\t"
+         "mem_used_total\t"
+         "mem_wasted_total\t"
+         "%%_of_mem_wasted\t"
+         "%%_of_mem_saved\t"
+         "options\n");
+  for (const auto &config : {current, best_growth_factor(classes), optimal_chunks(classes)}) {
+    if (config.chunks.empty()) {
+      // no growth factor makes as few classes
+      continue;
+    }
+    double mem = config_mem(config.chunks);
+    printf("CONFIG %s\t%zu\t%.0f\t%.0f\t%.1f\t%.1f\t%s\n",
+           config.name.c_str(),
+           config.chunks.size(),
+           mem * scale,
+           (mem - item_size) * scale,
+           (mem - item_size) * 100.0 / mem,
+           (current_mem - mem) * 100.0 / current_mem,
+           config.options.c_str());
+  }
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "item_aggregator.h"
+#include "item_processor.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+// How much memory the slab classes of memcached waste on the items found, and how much other
+// classes would: the sizes of the items are counted in a histogram of 8-byte bins, the alignment
+// of chunk sizes, so the memory of any set of chunk sizes follows from its prefix sums. Every -f
+// growth factor and -n minimum size are tried as memcached would make the classes from them, and
+// the best chunk sizes for a number of classes are found by dynamic programming over the bins.
+class SlabOptimizer: public ItemProcessor {
+public:
+  SlabOptimizer(SlabInfo *slabs_info, int max_slab_id);
+  bool set_arg(const char *argv);
+  ItemProcessor *clone(int worker_id) const;
+  void merge(ItemProcessor *other);
+  void set_sample_size(uint64_t sampled_units, uint64_t total_units);
+  void finish();
+  void process_item(unsigned int cur_time, const ItemView &item);
+
+private:
+  static const uint32_t kBinBytes = 8;
+  static const uint64_t kSlabPageSize = 1024 * 1024;
+
+  struct SlabUse {
+    uint64_t items;
+    uint64_t item_size;
+  };
+  struct Config {
+    std::string name;
+    std::string options;
+    // chunk sizes in ascending order, the last one is the largest chunk
+    std::vector<uint64_t> chunks;
+  };
+
+  // the largest chunk of the classes in the stats, items above it are stored in several chunks
+  void size_histogram();
+  // memory of a chunk of the size, with its share of the tail of the page no chunk fits in
+  static double chunk_mem(uint64_t chunk);
+  // memory of the items of bins (lo_bin, hi_bin] in chunks of hi_bin * kBinBytes
+  double group_mem(uint64_t lo_bin, uint64_t hi_bin) const;
+  double config_mem(const std::vector<uint64_t> &chunks) const;
+  std::vector<uint64_t> growth_factor_chunks(double factor, uint64_t min_size) const;
+  Config best_growth_factor(size_t max_classes) const;
+  Config optimal_chunks(size_t classes) const;
+
+  SlabInfo *slabs_info_;
+  int max_slab_id_;
+  // classes of the optimal chunk sizes, 0 for as many as memcached has
+  size_t classes_;
+  uint64_t max_chunk_;
+  std::vector<SlabUse> slab_use_;
+  // items of sizes ((b - 1) * kBinBytes, b * kBinBytes] at bin b, and their exact bytes
+  std::vector<uint64_t> bin_items_;
+  std::vector<uint64_t> bin_bytes_;
+  // prefix sums of bin_items_, built by finish()
+  std::vector<uint64_t> items_below_;
+  uint64_t large_items_;
+  uint64_t large_bytes_;
+  uint64_t sampled_units_;
+  uint64_t total_units_;
+};
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <stdint.h>
+
+
+// A snapshot file written by --snapshot-out starts with a SnapshotHeader, the stats file of
+// stats_size bytes and region_cnt SnapshotRegions. Then with kSnapshotRaw the memory of every region
+// is at its file_offset, which is page aligned so it can be mmapped. With kSnapshotZlib the memory
+// is cut into blocks of block_size, every one is a SnapshotBlock followed by its compressed pages,
+// blocks of only zero pages are left out, and block_cnt offsets of the blocks are at index_offset.
+const char kSnapshotMagic[8] = {'M', 'C', 'I', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t kSnapshotVersion = 2;
+const uint32_t kSnapshotPageSize = 4096;
+const uint32_t kSnapshotBlockSize = 1024 * 1024;
+
+enum SnapshotCompression {
+  kSnapshotRaw = 0,
+  kSnapshotZlib = 1,
+};
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t region_cnt;
+  uint32_t compression;
+  uint32_t block_size;
+  uint64_t stats_size;
+  uint64_t block_cnt;
+  uint64_t index_offset;
+};
+
+enum SnapshotRegionFlag {
+  // one of the areas of MemorySource::get_area_list()
+  kSnapshotHeap = 1,
+  // one of the areas of MemorySource::get_data_area_list()
+  kSnapshotData = 2,
+};
+
+struct SnapshotRegion {
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t file_offset;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+struct SnapshotBlock {
+  // address and bytes of the memory in the block, which does not cross regions
+  uint64_t lo;
+  uint32_t size;
+  uint32_t compressed_size;
+  // pages that are not all zero, only they are compressed
+  uint64_t page_bitmap[kSnapshotBlockSize / kSnapshotPageSize / 64];
+};
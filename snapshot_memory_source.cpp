@@ -0,0 +1,136 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "snapshot_memory_source.h"
+
+#include <string.h>
+#include <zlib.h>
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+bool SnapshotMemorySource::load_segments() {
+  auto header = reinterpret_cast<const SnapshotHeader *>(image_);
+  if (image_size_ < sizeof(SnapshotHeader) || memcmp(header->magic, kSnapshotMagic, sizeof(kSnapshotMagic))) {
+    fprintf(stderr, "%s is not a snapshot file\n", filename_.c_str());
+    return false;
+  }
+  if (header->version != kSnapshotVersion) {
+    fprintf(stderr, "%s is a snapshot of version %u, only version %u is supported\n",
+            filename_.c_str(), header->version, kSnapshotVersion);
+    return false;
+  }
+  if (header->compression != kSnapshotRaw && header->compression != kSnapshotZlib) {
+    fprintf(stderr, "%s is compressed in an unknown way %u\n", filename_.c_str(), header->compression);
+    return false;
+  }
+  compression_ = header->compression;
+  uint64_t regions_offset = sizeof(SnapshotHeader) + header->stats_size;
+  if (regions_offset + header->region_cnt * sizeof(SnapshotRegion) > image_size_
+      || header->index_offset + header->block_cnt * sizeof(uint64_t) > image_size_) {
+    fprintf(stderr, "%s is truncated\n", filename_.c_str());
+    return false;
+  }
+  stats_.assign(image_ + sizeof(SnapshotHeader), header->stats_size);
+
+  auto regions = reinterpret_cast<const SnapshotRegion *>(image_ + regions_offset);
+  for (uint32_t i = 0; i < header->region_cnt; i++) {
+    const auto &region = regions[i];
+    Area area((const char *)region.lo, (const char *)region.hi);
+    // compressed regions are not in the file as they are, copy_out() finds their blocks
+    uint64_t file_size = compression_ == kSnapshotRaw ? area.size() : 0;
+    segments_.push_back({area, region.file_offset, file_size,
+                         (region.flags & kSnapshotHeap) != 0, (region.flags & kSnapshotData) != 0});
+  }
+
+  auto block_offsets = reinterpret_cast<const uint64_t *>(image_ + header->index_offset);
+  for (uint64_t i = 0; compression_ != kSnapshotRaw && i < header->block_cnt; i++) {
+    auto block = reinterpret_cast<const SnapshotBlock *>(image_ + block_offsets[i]);
+    if (block_offsets[i] + sizeof(SnapshotBlock) > image_size_
+        || block_offsets[i] + sizeof(SnapshotBlock) + block->compressed_size > image_size_
+        || block->size > kSnapshotBlockSize) {
+      fprintf(stderr, "%s is truncated\n", filename_.c_str());
+      return false;
+    }
+    blocks_.push_back(block);
+  }
+  sort(blocks_.begin(), blocks_.end(), [](const SnapshotBlock *l, const SnapshotBlock *r) { return l->lo < r->lo; });
+  return true;
+}
+
+
+void SnapshotMemorySource::copy_out(const Segment &segment, uint64_t area_off, uint64_t len, char *dest) {
+  if (compression_ == kSnapshotRaw) {
+    MappedMemorySource::copy_out(segment, area_off, len, dest);
+    return;
+  }
+  // every thread keeps the block it expanded last, a scan reads one block in many pieces
+  static thread_local const SnapshotBlock *expanded_block = nullptr;
+  static thread_local vector<char> expanded(kSnapshotBlockSize);
+
+  uint64_t lo = (uint64_t)segment.area.lo + area_off;
+  uint64_t hi = lo + len;
+  while (lo < hi) {
+    auto it = upper_bound(blocks_.begin(), blocks_.end(), lo,
+                          [](uint64_t addr, const SnapshotBlock *block) { return addr < block->lo; });
+    uint64_t next;
+    if (it != blocks_.begin() && lo < (*(it - 1))->lo + (*(it - 1))->size) {
+      auto block = *(it - 1);
+      if (expanded_block != block) {
+        if (!expand_block(block, &expanded[0])) {
+          fprintf(stderr, "block at %p of %s is corrupted, read as zero\n", (const char *)block->lo, filename_.c_str());
+          memset(&expanded[0], 0, kSnapshotBlockSize);
+        }
+        expanded_block = block;
+      }
+      next = min(hi, block->lo + block->size);
+      memcpy(dest, &expanded[lo - block->lo], next - lo);
+    } else {
+      // blocks of only zero pages are not in the file
+      next = it == blocks_.end() ? hi : min(hi, (*it)->lo);
+      memset(dest, 0, next - lo);
+    }
+    dest += next - lo;
+    lo = next;
+  }
+}
+
+
+bool SnapshotMemorySource::expand_block(const SnapshotBlock *block, char *dest) const {
+  // the non-zero pages are decompressed to the front, then moved to their places from the last one
+  uLongf pages_size = kSnapshotBlockSize;
+  if (uncompress((Bytef *)dest, &pages_size, (const Bytef *)(block + 1), block->compressed_size) != Z_OK) {
+    return false;
+  }
+  uint64_t packed_off = pages_size;
+  for (int page = (block->size + kSnapshotPageSize - 1) / kSnapshotPageSize - 1; page >= 0; page--) {
+    char *slot = dest + page * kSnapshotPageSize;
+    if (block->page_bitmap[page / 64] & (1lu << (page % 64))) {
+      if (packed_off < kSnapshotPageSize) {
+        return false;
+      }
+      packed_off -= kSnapshotPageSize;
+      memmove(slot, dest + packed_off, kSnapshotPageSize);
+    } else {
+      memset(slot, 0, kSnapshotPageSize);
+    }
+  }
+  return packed_off == 0;
+}
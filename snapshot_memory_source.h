@@ -0,0 +1,44 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include "mapped_memory_source.h"
+#include "snapshot_format.h"
+
+
+// Reads a snapshot written by SnapshotWriter, see snapshot_format.h.
+class SnapshotMemorySource : public MappedMemorySource {
+public:
+  explicit SnapshotMemorySource(const std::string &filename) : MappedMemorySource(filename) {}
+
+  // a compressed block is expanded for every item read from it
+  bool fast_scattered_read() const { return compression_ == kSnapshotRaw; }
+  std::string get_stats() { return stats_; }
+
+protected:
+  bool load_segments();
+  void copy_out(const Segment &segment, uint64_t area_off, uint64_t len, char *dest);
+
+private:
+  // Decompresses a block to the memory it was made of, returns false if it is corrupted.
+  bool expand_block(const SnapshotBlock *block, char *dest) const;
+
+  std::string stats_;
+  uint32_t compression_;
+  // compressed blocks sorted by address
+  std::vector<const SnapshotBlock *> blocks_;
+};
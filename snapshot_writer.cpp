@@ -0,0 +1,236 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "snapshot_writer.h"
+#include "blocking_queue.h"
+#include "common.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+
+using namespace std;
+
+
+namespace {
+  bool is_zero_page(const char *page) {
+    auto words = reinterpret_cast<const uint64_t *>(page);
+    uint64_t bits = 0;
+    for (size_t i = 0; i < kSnapshotPageSize / sizeof(uint64_t); i++) {
+      bits |= words[i];
+    }
+    return bits == 0;
+  }
+}
+
+
+SnapshotWriter::SnapshotWriter(const string &filename, SnapshotCompression compression) {
+  filename_ = filename;
+  compression_ = compression;
+  fp_ = nullptr;
+  memset(&header_, 0, sizeof(header_));
+  total_read_ = 0;
+  total_written_ = 0;
+  throttle_ = nullptr;
+}
+
+
+bool SnapshotWriter::write(MemorySource *source, const string &stats, uint64_t block_size, int buffer_cnt) {
+  for (const auto &area : source->get_area_list()) {
+    regions_.push_back({(uint64_t)area.lo, (uint64_t)area.hi, 0, kSnapshotHeap, 0});
+  }
+  for (const auto &area : source->get_data_area_list()) {
+    bool found = false;
+    for (auto &region : regions_) {
+      if (region.lo == (uint64_t)area.lo && region.hi == (uint64_t)area.hi) {
+        region.flags |= kSnapshotData;
+        found = true;
+      }
+    }
+    if (!found) {
+      regions_.push_back({(uint64_t)area.lo, (uint64_t)area.hi, 0, kSnapshotData, 0});
+    }
+  }
+  uint64_t file_offset = sizeof(SnapshotHeader) + stats.size() + regions_.size() * sizeof(SnapshotRegion);
+  if (compression_ == kSnapshotRaw) {
+    const uint64_t page_size = getpagesize();
+    for (auto &region : regions_) {
+      region.file_offset = (file_offset + page_size - 1) / page_size * page_size;
+      file_offset = region.file_offset + region.hi - region.lo;
+    }
+  }
+
+  fp_ = fopen(filename_.c_str(), "wb");
+  if (!fp_) {
+    fprintf(stderr, "Can not open %s: %s\n", filename_.c_str(), strerror(errno));
+    return false;
+  }
+  memcpy(header_.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+  header_.version = kSnapshotVersion;
+  header_.region_cnt = regions_.size();
+  header_.compression = compression_;
+  header_.block_size = kSnapshotBlockSize;
+  header_.stats_size = stats.size();
+  // written again at the end, with the block index
+  bool ok = fwrite(&header_, sizeof(header_), 1, fp_) == 1
+    && fwrite(stats.data(), 1, stats.size(), fp_) == stats.size()
+    && fwrite(&regions_[0], sizeof(SnapshotRegion), regions_.size(), fp_) == regions_.size();
+  if (ok) {
+    ok = compression_ == kSnapshotRaw ? copy_raw(source, block_size) : copy_compressed(source, block_size, buffer_cnt);
+  }
+  if (ok && compression_ != kSnapshotRaw) {
+    header_.block_cnt = block_offsets_.size();
+    header_.index_offset = ftell(fp_);
+    ok = fwrite(&block_offsets_[0], sizeof(uint64_t), block_offsets_.size(), fp_) == block_offsets_.size()
+      && fseek(fp_, 0, SEEK_SET) == 0
+      && fwrite(&header_, sizeof(header_), 1, fp_) == 1
+      && fseek(fp_, 0, SEEK_END) == 0;
+  }
+  if (ok) {
+    total_written_ = ftell(fp_);
+  }
+  if (fclose(fp_) != 0 || !ok) {
+    fprintf(stderr, "Failed to write %s: %s\n", filename_.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+
+ssize_t SnapshotWriter::read_region(MemorySource *source, uint64_t lo, uint64_t len, char *pbuf) {
+  struct iovec local = {pbuf, len};
+  struct iovec remote = {(void *)lo, len};
+  if (throttle_) {
+    throttle_->before_read(len);
+  }
+  ssize_t read_bytes = source->read(&local, 1, &remote, 1);
+  if (throttle_) {
+    throttle_->after_read();
+  }
+  // memory freed while being copied is left zeroed
+  read_bytes = max<ssize_t>(0, read_bytes);
+  memset(pbuf + read_bytes, 0, len - read_bytes);
+  return read_bytes;
+}
+
+
+bool SnapshotWriter::copy_raw(MemorySource *source, uint64_t block_size) {
+  vector<char> buf(block_size);
+  for (size_t i = 0; i < regions_.size(); i++) {
+    const auto &region = regions_[i];
+    if (fseek(fp_, region.file_offset, SEEK_SET) != 0) {
+      return false;
+    }
+    for (uint64_t lo = region.lo; lo < region.hi; lo += block_size) {
+      uint64_t len = min(block_size, region.hi - lo);
+      total_read_ += read_region(source, lo, len, &buf[0]);
+      if (fwrite(&buf[0], 1, len, fp_) != len) {
+        return false;
+      }
+    }
+    fprintf(stderr, "copied region %lu/%lu of %lu KBytes\n", i + 1, regions_.size(), (region.hi - region.lo) / KB);
+  }
+  return true;
+}
+
+
+bool SnapshotWriter::copy_compressed(MemorySource *source, uint64_t block_size, int buffer_cnt) {
+  // blocks of the scan are cut at kSnapshotBlockSize too, so compressed blocks never cross them
+  block_size = max<uint64_t>(kSnapshotBlockSize, block_size / kSnapshotBlockSize * kSnapshotBlockSize);
+  struct ReadBlock {
+    char *pbuf;
+    uint64_t lo;
+    uint64_t size;
+  };
+  BlockingQueue<char *> free_buffers(buffer_cnt);
+  BlockingQueue<ReadBlock> read_blocks(buffer_cnt);
+  for (int i = 0; i < buffer_cnt; i++) {
+    free_buffers.push(new char[block_size]);
+  }
+
+  // the copy is done here, the compression and the writing in the background
+  atomic<bool> failed(false);
+  thread compressor([&] {
+    vector<char> pages(kSnapshotBlockSize);
+    vector<char> out(compressBound(kSnapshotBlockSize));
+    for (;;) {
+      auto block = read_blocks.pop();
+      if (!block.pbuf) {
+        break;
+      }
+      for (uint64_t off = 0; !failed && off < block.size; off += kSnapshotBlockSize) {
+        uint32_t size = min<uint64_t>(kSnapshotBlockSize, block.size - off);
+        failed = !write_block(block.lo + off, block.pbuf + off, size, &pages, &out);
+      }
+      free_buffers.push(block.pbuf);
+    }
+  });
+
+  for (size_t i = 0; i < regions_.size() && !failed; i++) {
+    const auto &region = regions_[i];
+    for (uint64_t lo = region.lo; lo < region.hi && !failed; lo += block_size) {
+      uint64_t len = min(block_size, region.hi - lo);
+      char *pbuf = free_buffers.pop();
+      total_read_ += read_region(source, lo, len, pbuf);
+      read_blocks.push({pbuf, lo, len});
+    }
+    fprintf(stderr, "copied region %lu/%lu of %lu KBytes\n", i + 1, regions_.size(), (region.hi - region.lo) / KB);
+  }
+  read_blocks.push({nullptr, 0, 0});
+  compressor.join();
+
+  for (int i = 0; i < buffer_cnt; i++) {
+    delete [] free_buffers.pop();
+  }
+  return !failed;
+}
+
+
+bool SnapshotWriter::write_block(uint64_t lo, const char *pbuf, uint32_t size, vector<char> *pages, vector<char> *out) {
+  SnapshotBlock block;
+  memset(&block, 0, sizeof(block));
+  block.lo = lo;
+  block.size = size;
+  uint64_t pages_size = 0;
+  for (uint32_t off = 0; off < size; off += kSnapshotPageSize) {
+    // areas are made of whole pages
+    if (!is_zero_page(pbuf + off)) {
+      int page = off / kSnapshotPageSize;
+      block.page_bitmap[page / 64] |= 1lu << (page % 64);
+      memcpy(&(*pages)[pages_size], pbuf + off, kSnapshotPageSize);
+      pages_size += kSnapshotPageSize;
+    }
+  }
+  if (pages_size == 0) {
+    return true;
+  }
+  uLongf compressed_size = out->size();
+  // the fastest level, the copy is not to be slowed down by the compression
+  if (compress2((Bytef *)&(*out)[0], &compressed_size, (const Bytef *)&(*pages)[0], pages_size, 1) != Z_OK) {
+    return false;
+  }
+  block.compressed_size = compressed_size;
+  block_offsets_.push_back(ftell(fp_));
+  return fwrite(&block, sizeof(block), 1, fp_) == 1
+    && fwrite(&(*out)[0], 1, compressed_size, fp_) == compressed_size;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include "memory_source.h"
+#include "scan_throttle.h"
+#include "snapshot_format.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+
+// Copies the areas of a memory source into a snapshot file, see snapshot_format.h.
+class SnapshotWriter {
+public:
+  SnapshotWriter(const std::string &filename, SnapshotCompression compression);
+
+  // Copies the memory through buffer_cnt buffers of block_size, with compression a background thread
+  // compresses one buffer while the next ones are filled. Returns false on the first error.
+  bool write(MemorySource *source, const std::string &stats, uint64_t block_size, int buffer_cnt);
+  uint64_t get_total_read() const { return total_read_; }
+  uint64_t get_total_written() const { return total_written_; }
+  // Paces the reads of memory by the throttle, not owned by the writer.
+  void set_throttle(ScanThrottle *throttle) { throttle_ = throttle; }
+
+private:
+  bool copy_raw(MemorySource *source, uint64_t block_size);
+  bool copy_compressed(MemorySource *source, uint64_t block_size, int buffer_cnt);
+  // Compresses and writes the non-zero pages of memory at lo, at most a block of kSnapshotBlockSize.
+  bool write_block(uint64_t lo, const char *pbuf, uint32_t size, std::vector<char> *pages, std::vector<char> *out);
+  ssize_t read_region(MemorySource *source, uint64_t lo, uint64_t len, char *pbuf);
+
+  std::string filename_;
+  SnapshotCompression compression_;
+  FILE *fp_;
+  SnapshotHeader header_;
+  std::vector<SnapshotRegion> regions_;
+  std::vector<uint64_t> block_offsets_;
+  uint64_t total_read_;
+  uint64_t total_written_;
+  ScanThrottle *throttle_;
+};
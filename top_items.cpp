@@ -0,0 +1,295 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "top_items.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace {
+  // makes std heaps min-heaps of the size, the top is the first item to drop
+  template <class Entry>
+  bool larger(const Entry &a, const Entry &b) {
+    return a.size > b.size;
+  }
+}
+
+
+TopItems::TopItems(SlabInfo *slabs_info, int max_slab_id):
+  slabs_info_(slabs_info),
+  max_slab_id_(max_slab_id),
+  n_arg_(10),
+  max_categories_arg_(256),
+  n_(10),
+  max_categories_(256),
+  untracked_items_(0),
+  sampled_units_(0),
+  total_units_(0) {
+  processor_summary_ = "The largest items overall, per slab class and per category, and the memory of slab classes";
+  processor_name_ = "top items";
+  args_.emplace_back("--top-n=$NUM", "Number of items in every list", "10");
+  args_.emplace_back("--top-max-categories=$NUM", "Number of categories that get a list, the first ones seen", "256");
+}
+
+
+bool TopItems::set_arg(const char *argv) {
+  const char *val = nullptr;
+  if ((val = is_arg(argv, "--top-n="))) {
+    n_arg_ = atol(val);
+  } else if ((val = is_arg(argv, "--top-max-categories="))) {
+    max_categories_arg_ = atol(val);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+bool TopItems::init() {
+  if (n_arg_ < 1 || max_categories_arg_ < 1) {
+    fprintf(stderr, "top_n and top_max_categories must be at least 1.\n");
+    return false;
+  }
+  // every list may fill up, in a worst case of an entry per item
+  double lists_size = double(n_arg_) * (1 + max_slab_id_ + max_categories_arg_) * sizeof(Entry);
+  if (lists_size > kMaxListsSize) {
+    fprintf(stderr, "%ld items in each of %ld lists take %.0f MB, more than %lu MB, "
+                    "lower --top-n or --top-max-categories.\n",
+            n_arg_, 1 + max_slab_id_ + max_categories_arg_, lists_size / MB, kMaxListsSize / MB);
+    return false;
+  }
+  n_ = n_arg_;
+  max_categories_ = max_categories_arg_;
+  slab_top_.resize(max_slab_id_);
+  slab_totals_.assign(max_slab_id_, SlabTotals{0, 0, 0});
+  return true;
+}
+
+
+ItemProcessor *TopItems::clone(int worker_id) const {
+  auto *top = new TopItems(slabs_info_, max_slab_id_);
+  top->n_arg_ = n_arg_;
+  top->max_categories_arg_ = max_categories_arg_;
+  top->init();
+  return top;
+}
+
+
+void TopItems::add(vector<Entry> *heap, const Entry &entry, size_t n) {
+  if (heap->size() < n) {
+    heap->push_back(entry);
+    push_heap(heap->begin(), heap->end(), larger<Entry>);
+  } else if (entry.size > heap->front().size) {
+    pop_heap(heap->begin(), heap->end(), larger<Entry>);
+    heap->back() = entry;
+    push_heap(heap->begin(), heap->end(), larger<Entry>);
+  }
+}
+
+
+void TopItems::merge(ItemProcessor *other) {
+  auto *top = static_cast<TopItems *>(other);
+  for (const auto &entry : top->top_) {
+    add(&top_, entry, n_);
+  }
+  for (int i = 0; i < max_slab_id_; i++) {
+    for (const auto &entry : top->slab_top_[i]) {
+      add(&slab_top_[i], entry, n_);
+    }
+    slab_totals_[i].items += top->slab_totals_[i].items;
+    slab_totals_[i].mem += top->slab_totals_[i].mem;
+    slab_totals_[i].item_size += top->slab_totals_[i].item_size;
+  }
+  untracked_items_ += top->untracked_items_;
+  for (uint32_t other_id = 0; other_id < top->category_top_.size(); other_id++) {
+    const ByteView &name = top->categories_.name(other_id);
+    int64_t id = categories_.find(name);
+    if (id < 0 && categories_.size() < max_categories_) {
+      id = categories_.intern(name);
+      category_top_.emplace_back();
+    }
+    if (id < 0) {
+      // only the items in the list are known, the rest of the category is not counted
+      untracked_items_ += top->category_top_[other_id].size();
+      continue;
+    }
+    for (const auto &entry : top->category_top_[other_id]) {
+      add(&category_top_[id], entry, n_);
+    }
+  }
+}
+
+
+void TopItems::process_item(unsigned int cur_time, const ItemView &item) {
+  if (item.slab_id < 0 || item.slab_id >= max_slab_id_) {
+    return;
+  }
+  uint32_t size = item.key.size + item.nbytes;
+  auto &totals = slab_totals_[item.slab_id];
+  totals.items++;
+  totals.mem += max<uint64_t>(slabs_info_[item.slab_id].unit_size, size);
+  totals.item_size += size;
+
+  int64_t category_id = categories_.find(item.category);
+  if (category_id < 0) {
+    if (categories_.size() < max_categories_) {
+      category_id = categories_.intern(item.category);
+      category_top_.emplace_back();
+    } else {
+      untracked_items_++;
+    }
+  }
+  auto takes = [&](const vector<Entry> &heap) {
+    return heap.size() < n_ || size > heap.front().size;
+  };
+  bool to_category = category_id >= 0 && takes(category_top_[category_id]);
+  bool to_slab = takes(slab_top_[item.slab_id]);
+  bool to_top = takes(top_);
+  if (!to_category && !to_slab && !to_top) {
+    return;
+  }
+
+  Entry entry;
+  entry.size = size;
+  entry.slab_id = item.slab_id;
+  entry.idle_secs = int(cur_time - item.touch_time);
+  entry.ttl = item.exp_time ? int64_t(item.exp_time) - cur_time : kNoTtl;
+  entry.key_size = min<size_t>(item.key.size, kMaxKeySize);
+  memcpy(entry.key, item.key.data, entry.key_size);
+  entry.category_size = min<size_t>(item.category.size, kMaxKeySize);
+  memcpy(entry.category, item.category.data, entry.category_size);
+  if (to_category) {
+    add(&category_top_[category_id], entry, n_);
+  }
+  if (to_slab) {
+    add(&slab_top_[item.slab_id], entry, n_);
+  }
+  if (to_top) {
+    add(&top_, entry, n_);
+  }
+}
+
+
+void TopItems::set_sample_size(uint64_t sampled_units, uint64_t total_units) {
+  sampled_units_ = sampled_units;
+  total_units_ = total_units;
+}
+
+
+vector<TopItems::Entry> TopItems::sorted(vector<Entry> *heap) {
+  sort_heap(heap->begin(), heap->end(), larger<Entry>);
+  return *heap;
+}
+
+
+uint64_t TopItems::item_mem(const Entry &entry) const {
+  return max<uint64_t>(slabs_info_[entry.slab_id].unit_size, entry.size);
+}
+
+
+void TopItems::print_entry(const char *label, const Entry &entry) const {
+  char ttl[24] = "-";
+  if (entry.ttl != kNoTtl) {
+    snprintf(ttl, sizeof(ttl), "%ld", entry.ttl);
+  }
+  printf("%s %.*s\t%.*s\t%d\t%u\t%lu\t%d\t%s\n",
+         label,
+         entry.key_size, entry.key,
+         entry.category_size, entry.category,
+         entry.slab_id,
+         entry.size,
+         item_mem(entry),
+         entry.idle_secs,
+         ttl);
+}
+
+
+void TopItems::finish() {
+  static const char kColumns[] = "key\t"
+                                 "category\t"
+                                 "slab_id\t"
+                                 "size\t"
+                                 "mem_used\t"
+                                 "since_last_touched\t"
+                                 "ttl\n";
+  bool sampled = sampled_units_ > 1 && sampled_units_ < total_units_;
+  double scale = sampled ? total_units_ * 1.0 / sampled_units_ : 1;
+
+  printf("\nLargest %zu items%s: \n", n_, sampled ? " of the sample" : "");
+  printf("%s", kColumns);
+  for (const auto &entry : sorted(&top_)) {
+    print_entry("TOP", entry);
+  }
+
+  // the classes that take the most memory first
+  vector<int> slabs;
+  for (int i = 0; i < max_slab_id_; i++) {
+    if (slab_totals_[i].items) {
+      slabs.push_back(i);
+    }
+  }
+  sort(slabs.begin(), slabs.end(), [this](int a, int b) { return slab_totals_[a].mem > slab_totals_[b].mem; });
+  printf("\nMemory of slab classes and the share of their %zu largest items%s: \n",
+         n_, sampled ? ", estimated from the sample" : "");
+  printf("slab_id\t"
+         "slot_size\t"
+         "Count\t"
+         "mem_used_total\t"
+         "item_size_total\t"
+         "%%_of_mem_used_by_items\t"
+         "%%_of_mem_used_by_largest\n");
+  for (int i : slabs) {
+    const auto &totals = slab_totals_[i];
+    uint64_t largest_mem = 0;
+    for (const auto &entry : slab_top_[i]) {
+      largest_mem += item_mem(entry);
+    }
+    printf("SLABMEM %d\t%lu\t%.0f\t%.0f\t%.0f\t%.1f\t%.2f\n",
+           i,
+           slabs_info_[i].unit_size,
+           totals.items * scale,
+           totals.mem * scale,
+           totals.item_size * scale,
+           totals.item_size * 100.0 / totals.mem,
+           largest_mem * 100.0 / (totals.mem * scale));
+  }
+
+  printf("\nLargest %zu items per slab class: \n", n_);
+  printf("%s", kColumns);
+  for (int i : slabs) {
+    for (const auto &entry : sorted(&slab_top_[i])) {
+      print_entry("SLABTOP", entry);
+    }
+  }
+
+  printf("\nLargest %zu items per category", n_);
+  if (untracked_items_) {
+    printf(", %lu items of the categories after the first %zu are left out", untracked_items_, max_categories_);
+  }
+  printf(": \n%s", kColumns);
+  for (auto &heap : category_top_) {
+    for (const auto &entry : sorted(&heap)) {
+      print_entry("CATTOP", entry);
+    }
+  }
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "category_interner.h"
+#include "item_aggregator.h"
+#include "item_processor.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+
+// The N largest items of memcached, overall, per slab class and per category, with the memory of
+// every slab class next to its largest items to tell which keys make a class grow. Every list is a
+// min-heap of N items, so most items are dropped after comparing their size with the top of one
+// heap. Categories get lists up to a fixed number of them, so the memory is bounded by
+// N * (1 + slab classes + categories) items however many items and categories there are.
+class TopItems: public ItemProcessor {
+public:
+  TopItems(SlabInfo *slabs_info, int max_slab_id);
+  bool set_arg(const char *argv);
+  bool init();
+  ItemProcessor *clone(int worker_id) const;
+  void merge(ItemProcessor *other);
+  void set_sample_size(uint64_t sampled_units, uint64_t total_units);
+  void finish();
+  void process_item(unsigned int cur_time, const ItemView &item);
+
+private:
+  static const uint32_t kMaxKeySize = 250;
+  static const int64_t kNoTtl = INT64_MAX;
+  // bound of the memory of all the lists of a processor, which every scan thread has
+  static const uint64_t kMaxListsSize = 64 * MB;
+
+  struct Entry {
+    // key size + value size
+    uint32_t size;
+    int slab_id;
+    int idle_secs;
+    // seconds to expire, negative when expired, kNoTtl if the item does not expire
+    int64_t ttl;
+    uint8_t key_size;
+    uint8_t category_size;
+    char key[kMaxKeySize];
+    char category[kMaxKeySize];
+  };
+  struct SlabTotals {
+    uint64_t items;
+    // slot size, or the item size for items larger than a slot
+    uint64_t mem;
+    uint64_t item_size;
+  };
+
+  static void add(std::vector<Entry> *heap, const Entry &entry, size_t n);
+  // Returns the entries of the heap from the largest one, the heap is used up.
+  static std::vector<Entry> sorted(std::vector<Entry> *heap);
+  void print_entry(const char *label, const Entry &entry) const;
+  uint64_t item_mem(const Entry &entry) const;
+
+  SlabInfo *slabs_info_;
+  int max_slab_id_;
+  // as given, checked by init()
+  int64_t n_arg_;
+  int64_t max_categories_arg_;
+  size_t n_;
+  size_t max_categories_;
+  std::vector<Entry> top_;
+  std::vector<std::vector<Entry>> slab_top_;
+  std::vector<SlabTotals> slab_totals_;
+  CategoryInterner categories_;
+  std::vector<std::vector<Entry>> category_top_;
+  // items of the categories beyond max_categories_, which have no list
+  uint64_t untracked_items_;
+  uint64_t sampled_units_;
+  uint64_t total_units_;
+};
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "work_stealing_queue.h"
+
+
+using namespace std;
+
+
+WorkStealingQueue::WorkStealingQueue(int worker_cnt) {
+  for (int i = 0; i < worker_cnt; i++) {
+    queues_.emplace_back(new TaskQueue());
+  }
+}
+
+
+void WorkStealingQueue::push(int worker_id, size_t task) {
+  auto &queue = *queues_[worker_id];
+  lock_guard<mutex> guard(queue.lock);
+  queue.tasks.push_back(task);
+}
+
+
+bool WorkStealingQueue::pop(int worker_id, size_t *task) {
+  {
+    auto &queue = *queues_[worker_id];
+    lock_guard<mutex> guard(queue.lock);
+    if (!queue.tasks.empty()) {
+      *task = queue.tasks.front();
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+
+  // own queue is drained, steal from the far end of others so the owner keeps its locality
+  for (size_t i = 1; i < queues_.size(); i++) {
+    auto &queue = *queues_[(worker_id + i) % queues_.size()];
+    lock_guard<mutex> guard(queue.lock);
+    if (!queue.tasks.empty()) {
+      *task = queue.tasks.back();
+      queue.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
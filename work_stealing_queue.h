@@ -0,0 +1,42 @@
+/*
+ * Copyright 2016 Quora, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <stddef.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+// Task queues of a pool of workers. A worker takes tasks from the front of its own queue,
+// and once that is empty it steals from the back of the other workers' queues.
+class WorkStealingQueue {
+public:
+  WorkStealingQueue(int worker_cnt);
+  void push(int worker_id, size_t task);
+  // returns false when there is no task left in any queue
+  bool pop(int worker_id, size_t *task);
+
+private:
+  struct TaskQueue {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+  };
+
+  std::vector<std::unique_ptr<TaskQueue>> queues_;
+};